@@ -29,6 +29,24 @@ typedef struct equix_solution {
     equix_idx idx[EQUIX_NUM_IDX];
 } equix_solution;
 
+/*
+ * Maximum size of a challenge prefix and of a complete challenge built
+ * from a prefix and a suffix.
+ */
+#define EQUIX_MAX_PREFIX 128
+#define EQUIX_MAX_PREFIXED_CHALLENGE 256
+
+/*
+ * Challenge prefix shared by many challenges, e.g. a service seed.
+ * This is a plain copy of the prefix bytes, not a hash midstate: every
+ * call that takes a prefix and a suffix copies both into a challenge
+ * buffer and hashes the whole challenge, so nothing is precomputed.
+ */
+typedef struct equix_prefix {
+    size_t size;
+    uint8_t data[EQUIX_MAX_PREFIX];
+} equix_prefix;
+
 /*
  * Solution verification results
  */
@@ -39,7 +57,9 @@ typedef enum equix_result {
     EQUIX_ORDER,            /* Indices are not in the correct order. */
     EQUIX_PARTIAL_SUM,      /* The partial sums of the hash values don't
                                have the required number of trailing zeroes. */
-    EQUIX_FINAL_SUM         /* The hash values don't sum to zero. */
+    EQUIX_FINAL_SUM,        /* The hash values don't sum to zero. */
+    EQUIX_TIMEOUT           /* The solution was not verified in time
+                               (only returned by the verification ring). */
 } equix_result;
 
 /*
@@ -55,8 +75,44 @@ typedef enum equix_ctx_flags {
     EQUIX_CTX_SOLVE = 1,        /* Context for solving */
     EQUIX_CTX_COMPILE = 2,      /* Compile internal hash function */
     EQUIX_CTX_HUGEPAGES = 4,    /* Allocate solver memory using HugePages */
+    EQUIX_CTX_TRY_COMPILE = 8,  /* Compile internal hash function if the
+                                   host allows executable memory, otherwise
+                                   fall back to the HashX interpreter
+                                   (same speed as without this flag) */
+    EQUIX_CTX_PROFILE = 16,     /* Take EQUIX_CTX_COMPILE and
+                                   EQUIX_CTX_HUGEPAGES from the host profile
+                                   file named by the EQUIX_PROFILE
+                                   environment variable, if it exists.
+                                   The file is read once per process */
+    EQUIX_CTX_AUTO_COMPILE = 32,/* Verification only: choose between the
+                                   interpreter and the compiler for each
+                                   challenge based on costs measured on
+                                   this host */
+    EQUIX_CTX_LOWMEM = 64,      /* Solver with a smaller heap (870 KB instead
+                                   of 1.9 MB) that recomputes hash values
+                                   instead of storing them. Finds the same
+                                   solutions, but is slower unless the cache
+                                   is small */
 } equix_ctx_flags;
 
+/*
+ * Host-specific solver configuration found by equix_tune.
+ */
+typedef struct equix_profile {
+    equix_ctx_flags flags;      /* EQUIX_CTX_COMPILE and EQUIX_CTX_HUGEPAGES */
+    int threads;                /* solver threads, 0 = not measured */
+    double solutions_per_sec;   /* measured with the selected flags */
+} equix_profile;
+
+/*
+ * Verification statistics of a context
+ */
+typedef struct equix_verify_stats {
+    uint64_t interpreted;       /* verifications with the interpreter */
+    uint64_t compiled;          /* verifications with compiled code */
+    uint64_t compilations;      /* challenges compiled */
+} equix_verify_stats;
+
 /* Sentinel value used to indicate unsupported type */
 #define EQUIX_NOTSUPP ((equix_ctx*)-1)
 
@@ -105,6 +161,51 @@ EQUIX_API equix_ctx* equix_alloc(equix_ctx_flags flags);
 */
 EQUIX_API void equix_free(equix_ctx* ctx);
 
+/*
+ * Measure the available solver configurations on this host with one
+ * thread and select the fastest one.
+ *
+ * @param profile  pointer where the selected configuration will be stored
+ * @param seconds  approximate duration of the measurement
+ *
+ * @return 1 on success, 0 if no solver context could be created
+ */
+EQUIX_API int equix_tune(equix_profile* profile, double seconds);
+
+/*
+ * Save a profile to a file.
+ *
+ * @return 1 on success, 0 on failure
+ */
+EQUIX_API int equix_profile_save(const equix_profile* profile, const char* path);
+
+/*
+ * Load a profile from a file.
+ *
+ * @return 1 on success, 0 if the file cannot be read or does not contain
+ *         the compile and hugepages settings
+ */
+EQUIX_API int equix_profile_load(equix_profile* profile, const char* path);
+
+/*
+ * Get the flags of an Equi-X context. For contexts created with
+ * EQUIX_CTX_TRY_COMPILE, the EQUIX_CTX_COMPILE flag tells whether the
+ * compiler or the fallback interpreter was selected.
+ *
+ * @param ctx is a pointer to the context
+ *
+ * @return the context flags
+ */
+EQUIX_API equix_ctx_flags equix_get_flags(const equix_ctx* ctx);
+
+/*
+ * Get the verification statistics of an Equi-X context.
+ *
+ * @param ctx     pointer to the context
+ * @param stats   pointer where the statistics will be stored
+ */
+EQUIX_API void equix_get_verify_stats(const equix_ctx* ctx, equix_verify_stats* stats);
+
 /*
  * Find Equi-X solutions for the given challenge.
  *
@@ -122,9 +223,84 @@ EQUIX_API int equix_solve(
     size_t challenge_size,
     equix_solution output[EQUIX_MAX_SOLS]);
 
+/*
+ * Generate the internal hash function for a challenge ahead of solving it.
+ * Challenges are prepared into one of two slots in the context, so that
+ * the hash function for the next challenge can be generated while the
+ * current one is being solved, e.g. on a helper thread.
+ *
+ * Each call must be paired with one call of equix_solve_prepared, in the
+ * same order. The call for challenge N+1 may run concurrently with
+ * equix_solve_prepared for challenge N, but it must complete before
+ * equix_solve_prepared for challenge N+1 is called.
+ *
+ * @param ctx             pointer to an Equi-X context
+ * @param challenge       pointer to the challenge data
+ * @param challenge_size  size of the challenge
+ *
+ * @return 1 if the challenge was prepared, 0 if the challenge is invalid,
+ *         the context is not a solver context or memory allocation failed
+ */
+EQUIX_API int equix_prepare(
+    equix_ctx* ctx,
+    const void* challenge,
+    size_t challenge_size);
+
+/*
+ * Find Equi-X solutions for the oldest challenge passed to equix_prepare.
+ *
+ * @param ctx             pointer to an Equi-X context
+ * @param output          pointer to the output array where solutions will be
+ *                        stored
+ *
+ * @return the number of solutions found
+ */
+EQUIX_API int equix_solve_prepared(
+    equix_ctx* ctx,
+    equix_solution output[EQUIX_MAX_SOLS]);
+
+/*
+ * Run the first solver stage for a challenge: generate the hash function
+ * and sort all hash values into the solver heap of the context. This stage
+ * is compute-bound, while the remaining stages (equix_solve_pairs) are
+ * bound by memory latency, so a solver can run the two halves on different
+ * threads and hand the context over between them. The context must not be
+ * used concurrently.
+ *
+ * @param ctx             pointer to an Equi-X context
+ * @param challenge       pointer to the challenge data
+ * @param challenge_size  size of the challenge
+ *
+ * @return 1 on success, 0 if the challenge is invalid or the context is not
+ *         a solver context
+ */
+EQUIX_API int equix_solve_hashes(
+    equix_ctx* ctx,
+    const void* challenge,
+    size_t challenge_size);
+
+/*
+ * Run the remaining solver stages for the challenge passed to the last
+ * call of equix_solve_hashes with the same context.
+ *
+ * @param ctx             pointer to an Equi-X context
+ * @param output          pointer to the output array where solutions will be
+ *                        stored
+ *
+ * @return the number of solutions found
+ */
+EQUIX_API int equix_solve_pairs(
+    equix_ctx* ctx,
+    equix_solution output[EQUIX_MAX_SOLS]);
+
 /*
  * Verify an Equi-X solution.
  *
+ * The context remembers the last challenge (up to 128 bytes), so solutions
+ * of the same challenge verified one after another build its hash function
+ * only once. Every new challenge is still compiled from scratch, including
+ * switching the code buffer between writable and executable.
+ *
  * @param ctx             pointer to an Equi-X context
  * @param challenge       pointer to the challenge data
  * @param challenge_size  size of the challenge
@@ -138,6 +314,327 @@ EQUIX_API equix_result equix_verify(
     size_t challenge_size,
     const equix_solution* solution);
 
+/*
+ * Verify several Equi-X solutions of one challenge. With
+ * EQUIX_CTX_AUTO_COMPILE, the number of solutions is used to choose
+ * between the interpreter and the compiler.
+ *
+ * @param ctx             pointer to an Equi-X context
+ * @param challenge       pointer to the challenge data
+ * @param challenge_size  size of the challenge
+ * @param solutions       pointer to the solutions to be verified
+ * @param count           number of solutions
+ * @param results         pointer to the output array of verification results
+ *
+ * @return the number of valid solutions
+ */
+EQUIX_API size_t equix_verify_batch(
+    equix_ctx* ctx,
+    const void* challenge,
+    size_t challenge_size,
+    const equix_solution solutions[],
+    size_t count,
+    equix_result results[]);
+
+/*
+ * Initialize a challenge prefix.
+ *
+ * @param prefix       pointer to the prefix to be initialized
+ * @param data         pointer to the prefix data
+ * @param size         size of the prefix (at most EQUIX_MAX_PREFIX)
+ *
+ * @return 1 on success, 0 if the prefix is too large
+ */
+EQUIX_API int equix_prefix_init(equix_prefix* prefix, const void* data, size_t size);
+
+/*
+ * Build a challenge from a prefix and a suffix.
+ *
+ * @param prefix       pointer to the prefix
+ * @param suffix       pointer to the suffix data
+ * @param suffix_size  size of the suffix
+ * @param output       pointer to the output buffer
+ *
+ * @return size of the challenge, 0 if it would be larger than
+ *         EQUIX_MAX_PREFIXED_CHALLENGE
+ */
+EQUIX_API size_t equix_prefix_challenge(
+    const equix_prefix* prefix,
+    const void* suffix,
+    size_t suffix_size,
+    uint8_t output[EQUIX_MAX_PREFIXED_CHALLENGE]);
+
+/*
+ * Same as equix_solve with the challenge prefix || suffix. The challenge
+ * is assembled on the stack by equix_prefix_challenge on every call.
+ *
+ * @return the number of solutions found, 0 if the challenge is too large
+ */
+EQUIX_API int equix_solve_suffix(
+    equix_ctx* ctx,
+    const equix_prefix* prefix,
+    const void* suffix,
+    size_t suffix_size,
+    equix_solution output[EQUIX_MAX_SOLS]);
+
+/*
+ * Same as equix_verify with the challenge prefix || suffix. The challenge
+ * is assembled on the stack by equix_prefix_challenge on every call.
+ *
+ * @return verification result, EQUIX_CHALLENGE if the challenge is too large
+ */
+EQUIX_API equix_result equix_verify_suffix(
+    equix_ctx* ctx,
+    const equix_prefix* prefix,
+    const void* suffix,
+    size_t suffix_size,
+    const equix_solution* solution);
+
+/*
+ * Opaque struct that holds a verification admission queue
+ */
+typedef struct equix_queue equix_queue;
+
+/*
+ * Maximum challenge size supported by the admission queue.
+ */
+#define EQUIX_QUEUE_MAX_CHALLENGE 256
+
+/*
+ * Admission queue statistics
+ */
+typedef struct equix_queue_stats {
+    uint64_t admitted;      /* entries added to the queue */
+    uint64_t rejected;      /* entries refused because the challenge was
+                               too large or the queue was full of entries
+                               with the same or higher effort */
+    uint64_t evicted;       /* entries removed to make room for entries
+                               with a higher effort */
+    uint64_t verified;      /* entries removed by equix_queue_verify */
+} equix_queue_stats;
+
+/*
+ * Allocate a bounded admission queue for solutions waiting to be verified.
+ * All memory is allocated upfront. The queue is safe to use from multiple
+ * threads.
+ *
+ * @param capacity      maximum number of pending entries
+ * @param max_challenge maximum challenge size (at most
+ *                      EQUIX_QUEUE_MAX_CHALLENGE)
+ *
+ * @return pointer to a newly created queue or NULL on failure
+ */
+EQUIX_API equix_queue* equix_queue_alloc(size_t capacity, size_t max_challenge);
+
+/*
+ * Free an admission queue.
+ *
+ * @param queue is a pointer to the queue
+ */
+EQUIX_API void equix_queue_free(equix_queue* queue);
+
+/*
+ * Add a solution to the queue. When the queue is full, the entry with the
+ * lowest effort is evicted if its effort is lower than the claimed effort,
+ * otherwise the new entry is rejected. No hashing is done by this function.
+ *
+ * @param queue           pointer to the queue
+ * @param challenge       pointer to the challenge data
+ * @param challenge_size  size of the challenge
+ * @param solution        pointer to the solution
+ * @param effort          effort claimed by the client
+ * @param tag             value returned by equix_queue_verify for this entry
+ * @param evicted_tag     if not NULL and an entry was evicted, its tag
+ *                        is stored here
+ *
+ * @return 1 if the entry was admitted, 2 if it was admitted and another
+ *         entry was evicted, 0 if it was rejected
+ */
+EQUIX_API int equix_queue_push(
+    equix_queue* queue,
+    const void* challenge,
+    size_t challenge_size,
+    const equix_solution* solution,
+    uint32_t effort,
+    uint64_t tag,
+    uint64_t* evicted_tag);
+
+/*
+ * Remove the entry with the highest effort from the queue and verify it.
+ * Entries with the same effort are verified in the order they were added.
+ *
+ * @param queue   pointer to the queue
+ * @param ctx     pointer to an Equi-X context owned by the calling thread
+ * @param result  pointer where the verification result will be stored
+ * @param tag     pointer where the tag of the entry will be stored
+ *
+ * @return 1 if an entry was verified, 0 if the queue is empty
+ */
+EQUIX_API int equix_queue_verify(
+    equix_queue* queue,
+    equix_ctx* ctx,
+    equix_result* result,
+    uint64_t* tag);
+
+/*
+ * Get the queue statistics.
+ *
+ * @param queue   pointer to the queue
+ * @param stats   pointer where the statistics will be stored
+ */
+EQUIX_API void equix_queue_get_stats(equix_queue* queue, equix_queue_stats* stats);
+
+/*
+ * Opaque struct that holds the state of a first-solution race
+ */
+typedef struct equix_race equix_race;
+
+/*
+ * Callback that decides if a solution qualifies, e.g. by checking it
+ * against a difficulty target. Must be thread-safe.
+ *
+ * @param challenge       pointer to the challenge data
+ * @param challenge_size  size of the challenge
+ * @param solution        pointer to the solution
+ * @param arg             user argument passed to equix_race_alloc
+ *
+ * @return nonzero if the solution qualifies
+ */
+typedef int equix_accept_func(
+    const void* challenge,
+    size_t challenge_size,
+    const equix_solution* solution,
+    void* arg);
+
+/*
+ * Allocate a race for the first qualifying solution. Worker number w of
+ * W workers tries the challenges prefix || nonce with nonce = start + w,
+ * start + w + W, start + w + 2W, ... The nonce is appended as 8 bytes in
+ * little-endian order.
+ *
+ * @param prefix   pointer to the challenge prefix, which is copied
+ * @param start    first nonce
+ * @param workers  number of workers
+ * @param accept   qualifying condition, NULL accepts any solution
+ * @param arg      user argument for the accept function
+ *
+ * @return pointer to a newly created race or NULL on failure
+ */
+EQUIX_API equix_race* equix_race_alloc(
+    const equix_prefix* prefix,
+    uint64_t start,
+    unsigned workers,
+    equix_accept_func* accept,
+    void* arg);
+
+/*
+ * Free a race. All workers must have returned.
+ *
+ * @param race is a pointer to the race
+ */
+EQUIX_API void equix_race_free(equix_race* race);
+
+/*
+ * Run one worker of a race. Each worker must be called exactly once with
+ * its own solver context, typically on its own thread. Returns when any
+ * worker has found a qualifying solution or the race was cancelled. The
+ * other workers stop at the next stage or bucket boundary of the solver.
+ *
+ * @param race    pointer to the race
+ * @param ctx     pointer to an Equi-X solver context
+ * @param worker  worker number from 0 to workers - 1
+ *
+ * @return 1 if this worker won the race, 0 otherwise
+ */
+EQUIX_API int equix_race_run(equix_race* race, equix_ctx* ctx, unsigned worker);
+
+/*
+ * Stop all workers of a race, e.g. on a timeout. Thread-safe.
+ *
+ * @param race    pointer to the race
+ */
+EQUIX_API void equix_race_cancel(equix_race* race);
+
+/*
+ * Get the winning solution of a race.
+ *
+ * @param race      pointer to the race
+ * @param nonce     pointer where the winning nonce will be stored
+ * @param solution  pointer where the winning solution will be stored
+ *
+ * @return 1 if a qualifying solution was found, 0 otherwise
+ */
+EQUIX_API int equix_race_result(equix_race* race, uint64_t* nonce, equix_solution* solution);
+
+/*
+ * Opaque struct that holds a cache of solver results
+ */
+typedef struct equix_cache equix_cache;
+
+/*
+ * Maximum challenge size supported by the solver cache. Larger challenges
+ * are always solved.
+ */
+#define EQUIX_CACHE_MAX_CHALLENGE 128
+
+/*
+ * Solver cache statistics
+ */
+typedef struct equix_cache_stats {
+    uint64_t hits;          /* results returned from the cache */
+    uint64_t misses;        /* challenges that had to be solved */
+    uint64_t expired;       /* misses because the entry was too old */
+    uint64_t evictions;     /* live entries replaced by new ones */
+} equix_cache_stats;
+
+/*
+ * Allocate a bounded cache of solver results. The cache is split into
+ * shards with their own locks for writers; readers do not take locks.
+ * All memory is allocated upfront.
+ *
+ * @param capacity     maximum number of cached challenges
+ * @param ttl          maximum age of a cached result in seconds
+ *
+ * @return pointer to a newly created cache or NULL on failure
+ */
+EQUIX_API equix_cache* equix_cache_alloc(size_t capacity, double ttl);
+
+/*
+ * Free a solver cache.
+ *
+ * @param cache is a pointer to the cache
+ */
+EQUIX_API void equix_cache_free(equix_cache* cache);
+
+/*
+ * Same as equix_solve, but returns a cached result if the challenge was
+ * solved less than ttl seconds ago. Thread-safe as long as each thread
+ * uses its own context.
+ *
+ * @param cache           pointer to the cache
+ * @param ctx             pointer to an Equi-X solver context
+ * @param challenge       pointer to the challenge data
+ * @param challenge_size  size of the challenge
+ * @param output          pointer to the output array where solutions will be
+ *                        stored
+ *
+ * @return the number of solutions found
+ */
+EQUIX_API int equix_cache_solve(
+    equix_cache* cache,
+    equix_ctx* ctx,
+    const void* challenge,
+    size_t challenge_size,
+    equix_solution output[EQUIX_MAX_SOLS]);
+
+/*
+ * Get the cache statistics.
+ *
+ * @param cache   pointer to the cache
+ * @param stats   pointer where the statistics will be stored
+ */
+EQUIX_API void equix_cache_get_stats(equix_cache* cache, equix_cache_stats* stats);
+
 #ifdef __cplusplus
 }
 #endif
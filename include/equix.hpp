@@ -0,0 +1,462 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#ifndef EQUIX_HPP
+#define EQUIX_HPP
+
+/*
+ * Header-only C++20 interface to the Equi-X library.
+ */
+
+#include <equix.h>
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <semaphore>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace equix {
+
+using solution = equix_solution;
+using result = equix_result;
+using challenge_view = std::span<const std::byte>;
+
+/*
+ * Thrown when the requested context type is not supported on this platform.
+ */
+class not_supported : public std::runtime_error {
+public:
+    not_supported() : std::runtime_error("equix: context type not supported") {}
+};
+
+/*
+ * The solutions found for one challenge. Stored inline, no allocations.
+ */
+class solutions {
+public:
+    const solution* begin() const noexcept { return sols_.data(); }
+    const solution* end() const noexcept { return sols_.data() + count_; }
+    std::size_t size() const noexcept { return count_; }
+    bool empty() const noexcept { return count_ == 0; }
+    const solution& operator[](std::size_t i) const noexcept { return sols_[i]; }
+    std::span<const solution> span() const noexcept { return { begin(), size() }; }
+private:
+    friend class context;
+    std::array<solution, EQUIX_MAX_SOLS> sols_;
+    std::size_t count_ = 0;
+};
+
+/*
+ * Move-only owner of an equix_ctx.
+ *
+ * @param flags is a combination of equix_ctx_flags
+ *
+ * @throws std::bad_alloc on memory allocation failure and
+ *         equix::not_supported if the requested type is not supported
+ */
+class context {
+public:
+    explicit context(int flags) :
+        ctx_(equix_alloc(static_cast<equix_ctx_flags>(flags))),
+        flags_(flags)
+    {
+        if (ctx_ == nullptr) {
+            throw std::bad_alloc();
+        }
+        if (ctx_ == EQUIX_NOTSUPP) {
+            ctx_ = nullptr;
+            throw not_supported();
+        }
+    }
+
+    ~context() {
+        equix_free(ctx_);
+    }
+
+    context(context&& other) noexcept :
+        ctx_(std::exchange(other.ctx_, nullptr)),
+        flags_(other.flags_) {}
+
+    context& operator=(context&& other) noexcept {
+        if (this != &other) {
+            equix_free(ctx_);
+            ctx_ = std::exchange(other.ctx_, nullptr);
+            flags_ = other.flags_;
+        }
+        return *this;
+    }
+
+    context(const context&) = delete;
+    context& operator=(const context&) = delete;
+
+    equix_ctx* get() const noexcept { return ctx_; }
+    int flags() const noexcept { return flags_; }
+
+    solutions solve(challenge_view challenge) {
+        solutions out;
+        out.count_ = equix_solve(ctx_, challenge.data(), challenge.size(),
+            out.sols_.data());
+        return out;
+    }
+
+    bool prepare(challenge_view challenge) {
+        return equix_prepare(ctx_, challenge.data(), challenge.size()) != 0;
+    }
+
+    solutions solve_prepared() {
+        solutions out;
+        out.count_ = equix_solve_prepared(ctx_, out.sols_.data());
+        return out;
+    }
+
+    result verify(challenge_view challenge, const solution& sol) {
+        return equix_verify(ctx_, challenge.data(), challenge.size(), &sol);
+    }
+
+    /*
+     * Verify several solutions of the same challenge.
+     *
+     * @throws std::length_error if results is shorter than sols
+     */
+    void verify(challenge_view challenge, std::span<const solution> sols,
+        std::span<result> results)
+    {
+        if (results.size() < sols.size()) {
+            throw std::length_error("equix: results span is too short");
+        }
+        equix_verify_batch(ctx_, challenge.data(), challenge.size(),
+            sols.data(), sols.size(), results.data());
+    }
+
+private:
+    equix_ctx* ctx_;
+    int flags_;
+};
+
+/*
+ * Per-thread pool of contexts. Leased contexts are returned to the pool
+ * of the calling thread, so after warm-up no allocations are made.
+ */
+class context_pool {
+public:
+    class lease {
+    public:
+        explicit lease(int flags) : ctx_(take(flags)) {}
+        ~lease() {
+            if (ctx_) {
+                try {
+                    free_list().push_back(std::move(*ctx_));
+                }
+                catch (const std::bad_alloc&) {
+                    /* not pooled, ctx_ frees the context */
+                }
+            }
+        }
+        lease(lease&& other) noexcept : ctx_(std::move(other.ctx_)) {
+            other.ctx_.reset();
+        }
+        lease& operator=(lease&&) = delete;
+        context& operator*() noexcept { return *ctx_; }
+        context* operator->() noexcept { return &*ctx_; }
+    private:
+        std::optional<context> ctx_;
+    };
+
+    static lease acquire(int flags = EQUIX_CTX_VERIFY) {
+        return lease(flags);
+    }
+
+private:
+    static std::vector<context>& free_list() {
+        thread_local std::vector<context> list;
+        return list;
+    }
+
+    static context take(int flags) {
+        auto& list = free_list();
+        for (auto it = list.rbegin(); it != list.rend(); ++it) {
+            if (it->flags() == flags) {
+                context ctx = std::move(*it);
+                list.erase(std::next(it).base());
+                return ctx;
+            }
+        }
+        return context(flags);
+    }
+};
+
+/*
+ * Verify a solution using a context from the thread-local pool.
+ */
+inline result verify(challenge_view challenge, const solution& sol,
+    int flags = EQUIX_CTX_VERIFY)
+{
+    auto ctx = context_pool::acquire(flags);
+    return ctx->verify(challenge, sol);
+}
+
+inline void verify(challenge_view challenge, std::span<const solution> sols,
+    std::span<result> results, int flags = EQUIX_CTX_VERIFY)
+{
+    auto ctx = context_pool::acquire(flags);
+    ctx->verify(challenge, sols, results);
+}
+
+namespace detail {
+
+template<class T>
+struct task_result {
+    std::optional<T> value;
+    template<class U>
+    void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+    T get() { return std::move(*value); }
+};
+
+template<>
+struct task_result<void> {
+    void return_void() noexcept {}
+    void get() {}
+};
+
+}
+
+/*
+ * Lazily started coroutine. The awaiting coroutine is resumed on the thread
+ * that completes the task.
+ */
+template<class T>
+class [[nodiscard]] task {
+public:
+    struct promise_type : detail::task_result<T> {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        task get_return_object() noexcept {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        struct final_awaiter {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(
+                std::coroutine_handle<promise_type> h) noexcept
+            {
+                auto cont = h.promise().continuation;
+                return cont ? cont : std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+        final_awaiter final_suspend() noexcept { return {}; }
+        void unhandled_exception() noexcept { error = std::current_exception(); }
+    };
+
+    task(task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    task& operator=(task&&) = delete;
+    ~task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> cont) noexcept {
+        handle_.promise().continuation = cont;
+        return handle_;
+    }
+    T await_resume() {
+        if (handle_.promise().error) {
+            std::rethrow_exception(handle_.promise().error);
+        }
+        return handle_.promise().get();
+    }
+
+private:
+    explicit task(std::coroutine_handle<promise_type> h) noexcept : handle_(h) {}
+    std::coroutine_handle<promise_type> handle_;
+};
+
+/*
+ * Fixed-size thread pool that runs coroutines. Each worker thread keeps
+ * its own solver and verifier contexts in the thread-local pool.
+ */
+class executor {
+public:
+    explicit executor(unsigned threads = std::thread::hardware_concurrency(),
+        int solve_flags = EQUIX_CTX_SOLVE | EQUIX_CTX_TRY_COMPILE,
+        int verify_flags = EQUIX_CTX_VERIFY) :
+        solve_flags_(solve_flags),
+        verify_flags_(verify_flags)
+    {
+        threads = std::max(threads, 1u);
+        for (unsigned i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] { run(); });
+        }
+    }
+
+    ~executor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cond_.notify_all();
+        for (auto& thread : workers_) {
+            thread.join();
+        }
+    }
+
+    executor(const executor&) = delete;
+    executor& operator=(const executor&) = delete;
+
+    int solve_flags() const noexcept { return solve_flags_; }
+    int verify_flags() const noexcept { return verify_flags_; }
+
+    void post(std::coroutine_handle<> h) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(h);
+        }
+        cond_.notify_one();
+    }
+
+    /*
+     * co_await ex.schedule() continues the coroutine on a worker thread.
+     */
+    auto schedule() noexcept {
+        struct awaiter {
+            executor* ex;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { ex->post(h); }
+            void await_resume() const noexcept {}
+        };
+        return awaiter{ this };
+    }
+
+private:
+    void run() {
+        for (;;) {
+            std::coroutine_handle<> h;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+                if (queue_.empty()) {
+                    return;
+                }
+                h = queue_.front();
+                queue_.pop_front();
+            }
+            h.resume();
+        }
+    }
+
+    int solve_flags_;
+    int verify_flags_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<std::coroutine_handle<>> queue_;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+};
+
+/*
+ * Solve and verify on an executor. The challenge and solution buffers must
+ * stay valid until the returned task completes.
+ */
+inline task<solutions> async_solve(executor& ex, challenge_view challenge) {
+    co_await ex.schedule();
+    auto ctx = context_pool::acquire(ex.solve_flags());
+    co_return ctx->solve(challenge);
+}
+
+inline task<result> async_verify(executor& ex, challenge_view challenge,
+    const solution& sol)
+{
+    co_await ex.schedule();
+    co_return verify(challenge, sol, ex.verify_flags());
+}
+
+inline task<void> async_verify(executor& ex, challenge_view challenge,
+    std::span<const solution> sols, std::span<result> results)
+{
+    co_await ex.schedule();
+    verify(challenge, sols, results, ex.verify_flags());
+}
+
+namespace detail {
+
+struct sync_wait_task {
+    struct promise_type {
+        std::binary_semaphore* done = nullptr;
+
+        sync_wait_task get_return_object() noexcept {
+            return { std::coroutine_handle<promise_type>::from_promise(*this) };
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept {
+            struct awaiter {
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                    h.promise().done->release();
+                }
+                void await_resume() const noexcept {}
+            };
+            return awaiter{};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+    std::coroutine_handle<promise_type> handle;
+};
+
+template<class T>
+sync_wait_task make_sync_wait_task(task<T>& t, detail::task_result<T>& out,
+    std::exception_ptr& error)
+{
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await t;
+        }
+        else {
+            out.return_value(co_await t);
+        }
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+}
+
+}
+
+/*
+ * Block the calling thread until the task completes.
+ */
+template<class T>
+T sync_wait(task<T> t) {
+    detail::task_result<T> out;
+    std::exception_ptr error;
+    std::binary_semaphore done(0);
+    auto waiter = detail::make_sync_wait_task(t, out, error);
+    waiter.handle.promise().done = &done;
+    waiter.handle.resume();
+    done.acquire();
+    waiter.handle.destroy();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return out.get();
+}
+
+}
+
+#endif
@@ -0,0 +1,143 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#ifndef EQUIX_RING_H
+#define EQUIX_RING_H
+
+#include <equix.h>
+
+/*
+ * Shared-memory verification ring (Linux only).
+ *
+ * Clients write (challenge, solution) records into a ring of slots in a
+ * shared memory file under /dev/shm. Verifier threads of the equix-verifyd
+ * process drain the ring and write the result back into the same slot.
+ * The fast path only uses atomic operations, futex system calls are made
+ * only when a verifier is idle or a client has to wait.
+ *
+ * Verifiers take any submitted record, so a client that is slow to submit
+ * its record does not delay the records of other clients. A client that
+ * stops between taking a ticket and submitting its record, or that never
+ * collects its result, would still keep its slot from being reused.
+ * Instead, the verifiers give up on a ticket that is not submitted within
+ * one second, and the next client that needs the slot takes over a result
+ * that has not been collected within one second. A client that resumes
+ * after that gets a failed submission or EQUIX_TIMEOUT. Verifiers copy a
+ * record before verifying it, but a client that is suspended for over a
+ * second while writing its record may still overwrite the record of the
+ * next client using that slot.
+ */
+
+/*
+ * Maximum challenge size accepted by the ring.
+ */
+#define EQUIX_RING_MAX_CHALLENGE 64
+
+/*
+ * Opaque struct that holds a mapped ring.
+ */
+typedef struct equix_ring equix_ring;
+
+/*
+ * Ticket identifying a submitted record.
+ */
+typedef uint32_t equix_ring_ticket;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Create a new ring. Any existing ring with the same name is replaced.
+ *
+ * @param name       name of the shared memory file under /dev/shm
+ * @param slots_log2 the ring will have 2^slots_log2 slots (3-16)
+ *
+ * @return pointer to the ring or NULL on failure
+ */
+EQUIX_API equix_ring* equix_ring_create(const char* name, unsigned slots_log2);
+
+/*
+ * Map an existing ring.
+ *
+ * @param name       name of the shared memory file under /dev/shm
+ *
+ * @return pointer to the ring or NULL on failure
+ */
+EQUIX_API equix_ring* equix_ring_open(const char* name);
+
+/*
+ * Unmap a ring.
+ *
+ * @param ring       pointer to the ring
+ */
+EQUIX_API void equix_ring_close(equix_ring* ring);
+
+/*
+ * Submit a solution for verification. Blocks while the ring is full.
+ * Every submitted ticket should be passed to equix_ring_wait exactly once,
+ * otherwise the slot is only released after a timeout.
+ *
+ * @param ring            pointer to the ring
+ * @param challenge       pointer to the challenge data
+ * @param challenge_size  size of the challenge
+ * @param solution        pointer to the solution to be verified
+ * @param ticket          pointer where the ticket will be stored
+ *
+ * @return 1 on success, 0 if the challenge is larger than
+ *         EQUIX_RING_MAX_CHALLENGE, the ticket was abandoned by the
+ *         verifiers or the ring has been shut down
+ */
+EQUIX_API int equix_ring_submit(
+    equix_ring* ring,
+    const void* challenge,
+    size_t challenge_size,
+    const equix_solution* solution,
+    equix_ring_ticket* ticket);
+
+/*
+ * Wait for the verification result of a submitted solution.
+ *
+ * @param ring       pointer to the ring
+ * @param ticket     ticket returned by equix_ring_submit
+ *
+ * @return verification result, EQUIX_CHALLENGE if the ring has been shut
+ *         down, EQUIX_TIMEOUT if the result was not collected in time and
+ *         the slot has been reused
+ */
+EQUIX_API equix_result equix_ring_wait(equix_ring* ring, equix_ring_ticket ticket);
+
+/*
+ * Verify a solution using the ring. Equivalent to equix_ring_submit
+ * followed by equix_ring_wait. Challenges that cannot be submitted
+ * are reported as EQUIX_CHALLENGE.
+ */
+EQUIX_API equix_result equix_ring_verify(
+    equix_ring* ring,
+    const void* challenge,
+    size_t challenge_size,
+    const equix_solution* solution);
+
+/*
+ * Verify a batch of submitted records. Blocks while the ring is empty.
+ *
+ * @param ring       pointer to the ring
+ * @param ctx        pointer to an Equi-X context owned by the calling thread
+ * @param max_batch  maximum number of records to verify
+ *
+ * @return the number of records verified, 0 if the ring has been shut down
+ */
+EQUIX_API unsigned equix_ring_serve(equix_ring* ring, equix_ctx* ctx, unsigned max_batch);
+
+/*
+ * Shut down the ring and wake up all waiting verifiers and clients.
+ *
+ * @param ring       pointer to the ring
+ */
+EQUIX_API void equix_ring_shutdown(equix_ring* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,108 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#ifndef ATOMICS_H
+#define ATOMICS_H
+
+#include <stdint.h>
+
+/*
+ * The few atomic operations used by the library. C11 <stdatomic.h> where
+ * available, Interlocked and volatile intrinsics with MSVC, whose C
+ * compiler only provides <stdatomic.h> with /experimental:c11atomics.
+ * Plain loads and stores are relaxed.
+ */
+
+#if defined(_MSC_VER) && !defined(__clang__)
+
+#include <windows.h>
+#include <intrin.h>
+
+typedef volatile long equix_atomic_int;
+typedef volatile LONG64 equix_atomic_u64;
+
+static inline void equix_atomic_init(equix_atomic_int* ptr, int value) {
+    *ptr = value;
+}
+
+static inline int equix_atomic_load(const equix_atomic_int* ptr) {
+    return __iso_volatile_load32((const volatile __int32*)ptr);
+}
+
+static inline int equix_atomic_load_acquire(const equix_atomic_int* ptr) {
+    int value = __iso_volatile_load32((const volatile __int32*)ptr);
+    MemoryBarrier();
+    return value;
+}
+
+static inline void equix_atomic_store(equix_atomic_int* ptr, int value) {
+    __iso_volatile_store32((volatile __int32*)ptr, value);
+}
+
+static inline void equix_atomic_store_release(equix_atomic_int* ptr, int value) {
+    MemoryBarrier();
+    __iso_volatile_store32((volatile __int32*)ptr, value);
+}
+
+static inline uint64_t equix_atomic_load_u64(const equix_atomic_u64* ptr) {
+    return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)ptr, 0, 0);
+}
+
+static inline void equix_atomic_add_u64(equix_atomic_u64* ptr, uint64_t value) {
+    InterlockedExchangeAdd64(ptr, (LONG64)value);
+}
+
+static inline void equix_atomic_fence_acquire(void) {
+    MemoryBarrier();
+}
+
+static inline void equix_atomic_fence_release(void) {
+    MemoryBarrier();
+}
+
+#else
+
+#include <stdatomic.h>
+
+typedef atomic_int equix_atomic_int;
+typedef _Atomic uint64_t equix_atomic_u64;
+
+static inline void equix_atomic_init(equix_atomic_int* ptr, int value) {
+    atomic_init(ptr, value);
+}
+
+static inline int equix_atomic_load(const equix_atomic_int* ptr) {
+    return atomic_load_explicit((equix_atomic_int*)ptr, memory_order_relaxed);
+}
+
+static inline int equix_atomic_load_acquire(const equix_atomic_int* ptr) {
+    return atomic_load_explicit((equix_atomic_int*)ptr, memory_order_acquire);
+}
+
+static inline void equix_atomic_store(equix_atomic_int* ptr, int value) {
+    atomic_store_explicit(ptr, value, memory_order_relaxed);
+}
+
+static inline void equix_atomic_store_release(equix_atomic_int* ptr, int value) {
+    atomic_store_explicit(ptr, value, memory_order_release);
+}
+
+static inline uint64_t equix_atomic_load_u64(const equix_atomic_u64* ptr) {
+    return atomic_load_explicit((equix_atomic_u64*)ptr, memory_order_relaxed);
+}
+
+static inline void equix_atomic_add_u64(equix_atomic_u64* ptr, uint64_t value) {
+    atomic_fetch_add_explicit(ptr, value, memory_order_relaxed);
+}
+
+static inline void equix_atomic_fence_acquire(void) {
+    atomic_thread_fence(memory_order_acquire);
+}
+
+static inline void equix_atomic_fence_release(void) {
+    atomic_thread_fence(memory_order_release);
+}
+
+#endif
+
+#endif
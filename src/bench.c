@@ -5,10 +5,22 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <equix.h>
 #include <test_utils.h>
 #include <hashx_thread.h>
 #include <hashx_time.h>
+#include "atomics.h"
+#include "bench_perf.h"
+#include "hooks.h"
+
+#ifdef EQUIX_WIN
+#include <windows.h>
+#define yield() SwitchToThread()
+#else
+#include <sched.h>
+#define yield() sched_yield()
+#endif
 
 typedef struct solver_output {
     equix_solution sols[EQUIX_MAX_SOLS];
@@ -23,13 +35,70 @@ typedef struct worker_job {
     int start;
     int step;
     int end;
+    bool pipeline;
+    bool stages;
+    equix_ctx* stage_ctx[2];
+    equix_atomic_int ready[2]; /* 1 = done by the helper, waiting for the worker */
     solver_output* output;
 } worker_job;
 
+/*
+ * Two-thread pipeline: the helper thread works on nonce N+1 while the
+ * worker thread finishes nonce N. With --stages, the helper runs stage 0
+ * (hashing) into one of two contexts and the worker runs stages 1-3
+ * (pairing). With --pipeline, the helper generates the hash function with
+ * equix_prepare and the worker calls equix_solve_prepared. The slots are
+ * handed over through ready without locks.
+ */
+static hashx_thread_retval helper_worker(void* args) {
+    worker_job* job = (worker_job*)args;
+    unsigned slot = 0;
+    for (int seed = job->start; seed < job->end; seed += job->step) {
+        while (equix_atomic_load_acquire(&job->ready[slot])) {
+            yield();
+        }
+        if (job->stages) {
+            equix_solve_hashes(job->stage_ctx[slot], &seed, sizeof(seed));
+        }
+        else {
+            equix_prepare(job->ctx, &seed, sizeof(seed));
+        }
+        equix_atomic_store_release(&job->ready[slot], 1);
+        slot ^= 1;
+    }
+    return HASHX_THREAD_SUCCESS;
+}
+
+static void pipeline_worker(worker_job* job) {
+    solver_output* outptr = job->output;
+    unsigned slot = 0;
+    equix_atomic_init(&job->ready[0], 0);
+    equix_atomic_init(&job->ready[1], 0);
+    hashx_thread helper = hashx_thread_create(&helper_worker, job);
+    for (int seed = job->start; seed < job->end; seed += job->step) {
+        while (!equix_atomic_load_acquire(&job->ready[slot])) {
+            yield();
+        }
+        int count = job->stages ?
+            equix_solve_pairs(job->stage_ctx[slot], outptr->sols) :
+            equix_solve_prepared(job->ctx, outptr->sols);
+        equix_atomic_store_release(&job->ready[slot], 0);
+        slot ^= 1;
+        outptr->count = count;
+        job->total_sols += count;
+        outptr++;
+    }
+    hashx_thread_join(helper);
+}
+
 static hashx_thread_retval worker(void* args) {
     worker_job* job = (worker_job*)args;
     job->total_sols = 0;
     solver_output* outptr = job->output;
+    if (job->pipeline || job->stages) {
+        pipeline_worker(job);
+        return HASHX_THREAD_SUCCESS;
+    }
     for (int seed = job->start; seed < job->end; seed += job->step) {
         int count = equix_solve(job->ctx, &seed, sizeof(seed), outptr->sols);
         outptr->count = count;
@@ -39,6 +108,159 @@ static hashx_thread_retval worker(void* args) {
     return HASHX_THREAD_SUCCESS;
 }
 
+typedef struct race_job {
+    hashx_thread thread;
+    equix_race* race;
+    equix_ctx* ctx;
+    unsigned worker;
+} race_job;
+
+static hashx_thread_retval race_worker(void* args) {
+    race_job* job = (race_job*)args;
+    equix_race_run(job->race, job->ctx, job->worker);
+    return HASHX_THREAD_SUCCESS;
+}
+
+/* accepts about 1 in *arg solutions */
+static int race_accept(const void* challenge, size_t challenge_size, const equix_solution* solution, void* arg) {
+    uint32_t difficulty = *(const uint32_t*)arg;
+    uint64_t hash = 0xcbf29ce484222325;
+    const uint8_t* data = (const uint8_t*)challenge;
+    for (size_t i = 0; i < challenge_size; ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3;
+    }
+    data = (const uint8_t*)solution;
+    for (size_t i = 0; i < sizeof(equix_solution); ++i) {
+        hash = (hash ^ data[i]) * 0x100000001b3;
+    }
+    return (hash >> 32) % difficulty == 0;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static int bench_race(int max_workers, int races, uint32_t difficulty, equix_ctx_flags flags) {
+    race_job* jobs = malloc(sizeof(race_job) * max_workers);
+    double* times = malloc(sizeof(double) * races);
+    if (jobs == NULL || times == NULL) {
+        printf("Error: memory allocation failure\n");
+        return 1;
+    }
+    for (int i = 0; i < max_workers; ++i) {
+        jobs[i].ctx = equix_alloc(flags);
+        if (jobs[i].ctx == NULL) {
+            printf("Error: memory allocation failure\n");
+            return 1;
+        }
+        if (jobs[i].ctx == EQUIX_NOTSUPP) {
+            printf("Error: not supported. Try with --interpret\n");
+            return 1;
+        }
+    }
+    printf("Racing for the first solution (races: %i, difficulty: %u) ...\n", races, difficulty);
+    printf("%8s %12s %12s %12s %12s\n", "workers", "mean (ms)", "p50 (ms)", "p90 (ms)", "max (ms)");
+    /* powers of two, then max_workers */
+    for (int workers = 1; workers <= max_workers;
+        workers = workers < max_workers && workers * 2 > max_workers ? max_workers : workers * 2)
+    {
+        double total = 0;
+        for (int r = 0; r < races; ++r) {
+            equix_prefix prefix;
+            equix_prefix_init(&prefix, &r, sizeof(r));
+            equix_race* race = equix_race_alloc(&prefix, 0, workers, &race_accept, &difficulty);
+            if (race == NULL) {
+                printf("Error: memory allocation failure\n");
+                return 1;
+            }
+            double time_start = hashx_time();
+            for (int i = 0; i < workers; ++i) {
+                jobs[i].race = race;
+                jobs[i].worker = i;
+            }
+            for (int i = 1; i < workers; ++i) {
+                jobs[i].thread = hashx_thread_create(&race_worker, &jobs[i]);
+            }
+            race_worker(&jobs[0]);
+            for (int i = 1; i < workers; ++i) {
+                hashx_thread_join(jobs[i].thread);
+            }
+            times[r] = hashx_time() - time_start;
+            total += times[r];
+            equix_race_free(race);
+        }
+        qsort(times, races, sizeof(double), &compare_double);
+        printf("%8i %12.2f %12.2f %12.2f %12.2f\n", workers, total * 1e3 / races,
+            times[races / 2] * 1e3, times[races * 9 / 10] * 1e3, times[races - 1] * 1e3);
+    }
+    for (int i = 0; i < max_workers; ++i) {
+        equix_free(jobs[i].ctx);
+    }
+    free(times);
+    free(jobs);
+    return 0;
+}
+
+/*
+ * Emulates a smaller last level cache: a background thread keeps reading
+ * a buffer of the given size, which evicts solver data from shared caches.
+ */
+typedef struct pressure_job {
+    hashx_thread thread;
+    volatile int stop;
+    uint8_t* buffer;
+    size_t size;
+    uint64_t sum;
+} pressure_job;
+
+static hashx_thread_retval pressure_worker(void* args) {
+    pressure_job* job = (pressure_job*)args;
+    while (!job->stop) {
+        for (size_t i = 0; i < job->size; i += 64) {
+            job->sum += job->buffer[i];
+        }
+    }
+    return HASHX_THREAD_SUCCESS;
+}
+
+/* solves every nonce twice through a solver cache */
+static int bench_cache(int start, int nonces, equix_ctx_flags flags) {
+    equix_ctx* ctx = equix_alloc(flags);
+    if (ctx == NULL) {
+        printf("Error: memory allocation failure\n");
+        return 1;
+    }
+    if (ctx == EQUIX_NOTSUPP) {
+        printf("Error: not supported. Try with --interpret\n");
+        return 1;
+    }
+    equix_cache* cache = equix_cache_alloc(2 * (size_t)nonces, 3600);
+    if (cache == NULL) {
+        printf("Error: memory allocation failure\n");
+        return 1;
+    }
+    printf("Solving nonces %i-%i twice through a cache ...\n", start, start + nonces - 1);
+    for (int pass = 0; pass < 2; ++pass) {
+        equix_solution sols[EQUIX_MAX_SOLS];
+        double time_start = hashx_time();
+        for (int seed = start; seed < start + nonces; ++seed) {
+            equix_cache_solve(cache, ctx, &seed, sizeof(seed), sols);
+        }
+        double elapsed = hashx_time() - time_start;
+        printf("%s: %.2f us/challenge\n", pass == 0 ? "first pass" : "repeat", elapsed * 1e6 / nonces);
+    }
+    equix_cache_stats stats;
+    equix_cache_get_stats(cache, &stats);
+    printf("hits: %llu, misses: %llu, expired: %llu, evictions: %llu\n",
+        (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+        (unsigned long long)stats.expired, (unsigned long long)stats.evictions);
+    equix_cache_free(cache);
+    equix_free(ctx);
+    return 0;
+}
+
 static void print_solution(int nonce, const equix_solution* sol) {
     output_hex((char*)&nonce, sizeof(nonce));
     printf(" : { ");
@@ -54,24 +276,79 @@ static const char* result_names[] = {
     "Invalid nonce",
     "Indices out of order",
     "Nonzero partial sum",
-    "Nonzero final sum"
+    "Nonzero final sum",
+    "Timeout"
 };
 
+/*
+ * Verifies all solutions and returns the elapsed time. Unless hash_cache
+ * is set, the hash function is rebuilt for every solution, so the result
+ * is not flattered by the repeat-challenge cache of the context.
+ */
+static double verify_all(worker_job* jobs, int threads, equix_ctx* verify_ctx, bool hash_cache) {
+    double time_start = hashx_time();
+    for (int thd = 0; thd < threads; ++thd) {
+        worker_job* job = &jobs[thd];
+        solver_output* outptr = job->output;
+        equix_ctx* ctx = verify_ctx != NULL ? verify_ctx : job->ctx;
+        for (int seed = job->start; seed < job->end; seed += job->step) {
+            for (int sol = 0; sol < outptr->count; ++sol) {
+                if (!hash_cache) {
+                    equix_invalidate_hash(ctx);
+                }
+                equix_result result = equix_verify(ctx, &seed, sizeof(seed), &outptr->sols[sol]);
+                if (result != EQUIX_OK && !hash_cache) {
+                    printf("Invalid solution (%s):\n", result_names[result]);
+                    print_solution(seed, &outptr->sols[sol]);
+                }
+            }
+            outptr++;
+        }
+    }
+    return hashx_time() - time_start;
+}
+
+/* the thread count measured by equix-tune, if EQUIX_PROFILE names a profile */
+static int profile_threads(void) {
+    const char* path = getenv("EQUIX_PROFILE");
+    equix_profile profile;
+    if (path != NULL && equix_profile_load(&profile, path) && profile.threads > 0) {
+        return profile.threads;
+    }
+    return 1;
+}
+
 static void print_help(char* executable) {
     printf("Usage: %s [OPTIONS]\n", executable);
     printf("Supported options:\n");
     printf("  --help        show this message\n");
     printf("  --nonces N    solve N nonces (default: N=500)\n");
     printf("  --start S     start with nonce S (default: S=0)\n");
-    printf("  --threads T   use T threads (default: T=1)\n");
+    printf("  --threads T   use T threads (default: from the EQUIX_PROFILE file, or T=1)\n");
     printf("  --interpret   use HashX interpreter\n");
+    printf("  --try-compile use HashX compiler if the host allows it,\n");
+    printf("                otherwise fall back to the interpreter\n");
     printf("  --hugepages   use hugepages\n");
+    printf("  --lowmem      use the low-memory solver\n");
+    printf("  --cache-pressure M  stream through M MiB on a helper thread to\n");
+    printf("                emulate a CPU with a smaller shared cache\n");
+    printf("  --pipeline    prepare the next nonce on a helper thread\n");
+    printf("  --stages      hash the next nonce on a helper thread while pairing\n");
+    printf("                the current one (2 threads per solver)\n");
+    printf("  --race K      time to the first solution with 1, 2, 4 ... K threads\n");
+    printf("  --races R     number of races per thread count (default: R=50)\n");
+    printf("  --difficulty D  only accept about 1 in D solutions in races (default: D=1)\n");
+    printf("  --verify-auto verify with EQUIX_CTX_AUTO_COMPILE\n");
+    printf("  --cache       solve every nonce twice through a solver cache\n");
     printf("  --sols        print all solutions\n");
+    printf("  --perf        print hardware performance counters per solver stage\n");
+    printf("  --perf-raw E  also count raw PMU event E (hex), e.g. L2 misses\n");
 }
 
 int main(int argc, char** argv) {
-    int nonces, start, threads;
-    bool interpret, huge_pages, print_sols, help;
+    int nonces, start, threads, race, races, difficulty;
+    int cache_pressure;
+    bool interpret, try_compile, huge_pages, lowmem, pipeline, stages, verify_auto, cache, print_sols, perf, help;
     read_option("--help", argc, argv, &help);
     if (help) {
         print_help(argv[0]);
@@ -80,16 +357,48 @@ int main(int argc, char** argv) {
     read_int_option("--nonces", argc, argv, &nonces, 500);
     read_int_option("--start", argc, argv, &start, 0);
     read_option("--interpret", argc, argv, &interpret);
+    read_option("--try-compile", argc, argv, &try_compile);
     read_option("--hugepages", argc, argv, &huge_pages);
+    read_option("--lowmem", argc, argv, &lowmem);
+    read_int_option("--cache-pressure", argc, argv, &cache_pressure, 0);
+    read_option("--pipeline", argc, argv, &pipeline);
+    read_option("--stages", argc, argv, &stages);
+    read_option("--verify-auto", argc, argv, &verify_auto);
+    read_option("--cache", argc, argv, &cache);
     read_option("--sols", argc, argv, &print_sols);
-    read_int_option("--threads", argc, argv, &threads, 1);
+    read_int_option("--threads", argc, argv, &threads, profile_threads());
+    read_option("--perf", argc, argv, &perf);
+    read_int_option("--race", argc, argv, &race, 0);
+    read_int_option("--races", argc, argv, &races, 50);
+    read_int_option("--difficulty", argc, argv, &difficulty, 1);
+    uint64_t perf_raw = 0;
+    for (int i = 0; i < argc - 1; ++i) {
+        if (strcmp(argv[i], "--perf-raw") == 0) {
+            perf_raw = strtoull(argv[i + 1], NULL, 16);
+        }
+    }
     equix_ctx_flags flags = EQUIX_CTX_SOLVE;
-    if (!interpret) {
+    if (try_compile) {
+        flags |= EQUIX_CTX_TRY_COMPILE;
+    }
+    else if (!interpret) {
         flags |= EQUIX_CTX_COMPILE;
     }
     if (huge_pages) {
         flags |= EQUIX_CTX_HUGEPAGES;
     }
+    if (lowmem) {
+        flags |= EQUIX_CTX_LOWMEM;
+    }
+    if (perf) {
+        return bench_perf(start, nonces, flags, perf_raw);
+    }
+    if (cache) {
+        return bench_cache(start, nonces, flags);
+    }
+    if (race > 0) {
+        return bench_race(race, races > 0 ? races : 1, difficulty > 0 ? difficulty : 1, flags);
+    }
     worker_job* jobs = malloc(sizeof(worker_job) * threads);
     if (jobs == NULL) {
         printf("Error: memory allocation failure\n");
@@ -106,19 +415,49 @@ int main(int argc, char** argv) {
             printf("Error: not supported. Try with --interpret\n");
             return 1;
         }
+        interpret = (equix_get_flags(jobs[thd].ctx) & EQUIX_CTX_COMPILE) == 0;
         jobs[thd].id = thd;
         jobs[thd].start = start + thd;
         jobs[thd].step = threads;
         jobs[thd].end = start + nonces;
+        jobs[thd].pipeline = pipeline;
+        jobs[thd].stages = stages;
+        jobs[thd].stage_ctx[0] = jobs[thd].ctx;
+        jobs[thd].stage_ctx[1] = NULL;
+        if (stages) {
+            jobs[thd].stage_ctx[1] = equix_alloc(flags);
+            if (jobs[thd].stage_ctx[1] == NULL || jobs[thd].stage_ctx[1] == EQUIX_NOTSUPP) {
+                printf("Error: memory allocation failure\n");
+                return 1;
+            }
+        }
         jobs[thd].output = malloc(sizeof(solver_output) * per_thread);
         if (jobs[thd].output == NULL) {
             printf("Error: memory allocation failure\n");
             return 1;
         }
     }
-    printf("Solving nonces %i-%i (interpret: %i, hugepages: %i, threads: %i) ...\n", start, start + nonces - 1, interpret, huge_pages, threads);
+    printf("Solving nonces %i-%i (interpret: %i, hugepages: %i, pipeline: %i, stages: %i, threads: %i) ...\n", start, start + nonces - 1, interpret, huge_pages, pipeline, stages, threads);
+    printf("Solver heap: %zu bytes per context (lowmem: %i)\n",
+        equix_hook_heap_size(flags), lowmem);
+    pressure_job pressure;
+    pressure.stop = 0;
+    pressure.sum = 0;
+    pressure.size = (size_t)cache_pressure << 20;
+    pressure.buffer = NULL;
+    if (cache_pressure > 0) {
+        pressure.buffer = malloc(pressure.size);
+        if (pressure.buffer == NULL) {
+            printf("Error: memory allocation failure\n");
+            return 1;
+        }
+        memset(pressure.buffer, 1, pressure.size);
+        pressure.thread = hashx_thread_create(&pressure_worker, &pressure);
+        printf("Cache pressure: %i MiB\n", cache_pressure);
+    }
     int total_sols = 0;
     double time_start, time_end;
+    clock_t cpu_start = clock();
     time_start = hashx_time();
     if (threads > 1) {
         for (int thd = 0; thd < threads; ++thd) {
@@ -132,12 +471,20 @@ int main(int argc, char** argv) {
         worker(jobs);
     }
     time_end = hashx_time();
+    if (cache_pressure > 0) {
+        pressure.stop = 1;
+        hashx_thread_join(pressure.thread);
+        free(pressure.buffer);
+    }
+    double cpu_time = (double)(clock() - cpu_start) / CLOCKS_PER_SEC;
     for (int thd = 0; thd < threads; ++thd) {
         total_sols += jobs[thd].total_sols;
     }
     double elapsed = time_end - time_start;
+    int total_threads = stages ? 2 * threads : threads;
     printf("%f solutions/nonce\n", total_sols / (double)nonces);
-    printf("%f solutions/sec. (%i thread%s)\n", total_sols / elapsed, threads, threads > 1 ? "s" : "");
+    printf("%f solutions/sec. (%i thread%s)\n", total_sols / elapsed, total_threads, total_threads > 1 ? "s" : "");
+    printf("%f ms CPU time/solution\n", total_sols > 0 ? cpu_time * 1e3 / total_sols : 0.0);
     if (print_sols) {
         for (int thd = 0; thd < threads; ++thd) {
             worker_job* job = &jobs[thd];
@@ -150,24 +497,36 @@ int main(int argc, char** argv) {
             }
         }
     }
-    time_start = hashx_time();
-    for (int thd = 0; thd < threads; ++thd) {
-        worker_job* job = &jobs[thd];
-        solver_output* outptr = job->output;
-        for (int seed = job->start; seed < job->end; seed += job->step) {
-            for (int sol = 0; sol < outptr->count; ++sol) {
-                equix_result result = equix_verify(job->ctx, &seed, sizeof(seed), &outptr->sols[sol]);
-                if (result != EQUIX_OK) {
-                    printf("Invalid solution (%s):\n", result_names[result]);
-                    print_solution(seed, &outptr->sols[sol]);
-                }
-            }
-            outptr++;
+    equix_ctx* verify_ctx = NULL;
+    if (verify_auto) {
+        verify_ctx = equix_alloc(EQUIX_CTX_VERIFY | EQUIX_CTX_AUTO_COMPILE);
+        if (verify_ctx == NULL || verify_ctx == EQUIX_NOTSUPP) {
+            printf("Error: memory allocation failure\n");
+            return 1;
         }
     }
-    time_end = hashx_time();
-    printf("%f verifications/sec. (1 thread)\n", total_sols / (time_end - time_start));
+    double verify_time = verify_all(jobs, threads, verify_ctx, false);
+    printf("%f verifications/sec. (1 thread)\n", total_sols / verify_time);
+    equix_verify_stats uncached = { 0 };
+    if (verify_auto) {
+        equix_get_verify_stats(verify_ctx, &uncached);
+    }
+    verify_time = verify_all(jobs, threads, verify_ctx, true);
+    printf("%f verifications/sec. with hash cache (1 thread)\n", total_sols / verify_time);
+    if (verify_auto) {
+        equix_verify_stats cached;
+        equix_get_verify_stats(verify_ctx, &cached);
+        printf("verify paths: %llu interpreted, %llu compiled (%llu compilations)\n",
+            (unsigned long long)uncached.interpreted, (unsigned long long)uncached.compiled,
+            (unsigned long long)uncached.compilations);
+        printf("with hash cache: %llu interpreted, %llu compiled (%llu compilations)\n",
+            (unsigned long long)(cached.interpreted - uncached.interpreted),
+            (unsigned long long)(cached.compiled - uncached.compiled),
+            (unsigned long long)(cached.compilations - uncached.compilations));
+        equix_free(verify_ctx);
+    }
     for (int thd = 0; thd < threads; ++thd) {
+        equix_free(jobs[thd].stage_ctx[1]);
         free(jobs[thd].output);
     }
     free(jobs);
@@ -0,0 +1,118 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+/*
+ * Compares the C++ interface in equix.hpp against direct use of the C API.
+ */
+
+#include <equix.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+struct nonce_output {
+    int nonce;
+    equix::solutions sols;
+};
+
+static double now() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static equix::challenge_view as_challenge(const int& nonce) {
+    return std::as_bytes(std::span<const int, 1>(&nonce, 1));
+}
+
+static int read_int_option(const char* option, int argc, char** argv, int def) {
+    for (int i = 0; i < argc - 1; ++i) {
+        if (std::strcmp(argv[i], option) == 0) {
+            return std::atoi(argv[i + 1]);
+        }
+    }
+    return def;
+}
+
+int main(int argc, char** argv) {
+    int nonces = read_int_option("--nonces", argc, argv, 100);
+    int rounds = read_int_option("--rounds", argc, argv, 20);
+    int threads = read_int_option("--threads", argc, argv, 1);
+    int flags = EQUIX_CTX_SOLVE | EQUIX_CTX_COMPILE;
+
+    equix_ctx* c_ctx = equix_alloc(static_cast<equix_ctx_flags>(flags));
+    if (c_ctx == nullptr || c_ctx == EQUIX_NOTSUPP) {
+        std::printf("Error: cannot allocate a solver context\n");
+        return 1;
+    }
+    equix::context cpp_ctx(flags);
+    std::vector<nonce_output> outputs(nonces);
+    int total_sols = 0;
+
+    std::printf("Solving %i nonces ...\n", nonces);
+    double time_start = now();
+    for (int nonce = 0; nonce < nonces; ++nonce) {
+        equix_solution sols[EQUIX_MAX_SOLS];
+        total_sols += equix_solve(c_ctx, &nonce, sizeof(nonce), sols);
+    }
+    double c_solve = now() - time_start;
+    time_start = now();
+    for (int nonce = 0; nonce < nonces; ++nonce) {
+        outputs[nonce].nonce = nonce;
+        outputs[nonce].sols = cpp_ctx.solve(as_challenge(nonce));
+    }
+    double cpp_solve = now() - time_start;
+    std::printf("C API:   %f solutions/sec.\n", total_sols / c_solve);
+    std::printf("C++ API: %f solutions/sec.\n", total_sols / cpp_solve);
+
+    equix_ctx* c_verify = equix_alloc(EQUIX_CTX_VERIFY);
+    if (c_verify == nullptr || c_verify == EQUIX_NOTSUPP) {
+        std::printf("Error: cannot allocate a verifier context\n");
+        return 1;
+    }
+    int failures = 0;
+    time_start = now();
+    for (int r = 0; r < rounds; ++r) {
+        for (auto& out : outputs) {
+            for (auto& sol : out.sols) {
+                failures += equix_verify(c_verify, &out.nonce, sizeof(out.nonce), &sol) != EQUIX_OK;
+            }
+        }
+    }
+    double c_verify_time = now() - time_start;
+    time_start = now();
+    for (int r = 0; r < rounds; ++r) {
+        for (auto& out : outputs) {
+            for (auto& sol : out.sols) {
+                failures += equix::verify(as_challenge(out.nonce), sol) != EQUIX_OK;
+            }
+        }
+    }
+    double cpp_verify_time = now() - time_start;
+    std::printf("C API:   %f verifications/sec.\n", rounds * total_sols / c_verify_time);
+    std::printf("C++ API: %f verifications/sec. (thread-local pool)\n", rounds * total_sols / cpp_verify_time);
+
+    {
+        equix::executor ex(threads, flags);
+        time_start = now();
+        for (auto& out : outputs) {
+            equix::result results[EQUIX_MAX_SOLS];
+            equix::sync_wait(equix::async_verify(ex, as_challenge(out.nonce),
+                out.sols.span(), results));
+            for (std::size_t i = 0; i < out.sols.size(); ++i) {
+                failures += results[i] != EQUIX_OK;
+            }
+        }
+        double async_verify_time = now() - time_start;
+        std::printf("C++ API: %f verifications/sec. (executor, sync_wait per nonce)\n", total_sols / async_verify_time);
+    }
+
+    if (failures != 0) {
+        std::printf("Error: %i verifications failed\n", failures);
+        return 1;
+    }
+    equix_free(c_verify);
+    equix_free(c_ctx);
+    return 0;
+}
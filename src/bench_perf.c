@@ -0,0 +1,218 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+/*
+ * Hardware performance counter profiling for equix-bench (Linux only).
+ * Counters are opened for user space only, so this works without root
+ * when /proc/sys/kernel/perf_event_paranoid is 2 or lower.
+ */
+
+#include "bench_perf.h"
+
+#ifdef __linux__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <hashx_time.h>
+#include "hooks.h"
+
+#define HW_CACHE(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+typedef struct perf_counter {
+    const char* name;
+    uint32_t type;
+    uint64_t config;
+    int fd;
+} perf_counter;
+
+static perf_counter counters[] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1 },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1 },
+    { "L1D misses", PERF_TYPE_HW_CACHE, HW_CACHE(PERF_COUNT_HW_CACHE_L1D,
+        PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS), -1 },
+    { "LLC misses", PERF_TYPE_HW_CACHE, HW_CACHE(PERF_COUNT_HW_CACHE_LL,
+        PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS), -1 },
+    { "dTLB misses", PERF_TYPE_HW_CACHE, HW_CACHE(PERF_COUNT_HW_CACHE_DTLB,
+        PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS), -1 },
+    { "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1 },
+    { "raw", PERF_TYPE_RAW, 0, -1 }, /* e.g. L2 misses, set by --perf-raw */
+};
+
+#define NUM_COUNTERS (sizeof(counters) / sizeof(counters[0]))
+#define RAW_COUNTER (NUM_COUNTERS - 1)
+
+enum {
+    REGION_HASHX_MAKE,
+    REGION_HASHX_EXEC,
+    REGION_STAGE0,
+    REGION_STAGE1,
+    REGION_STAGE2,
+    REGION_STAGE3,
+    REGION_VERIFY,
+    NUM_REGIONS
+};
+
+static const char* region_names[NUM_REGIONS] = {
+    "hashx_make",
+    "hashx_exec x 65536",
+    "stage 0",
+    "stage 1",
+    "stage 2",
+    "stage 3",
+    "verify (per solution)",
+};
+
+static double totals[NUM_REGIONS][NUM_COUNTERS];
+static double total_time[NUM_REGIONS];
+static uint64_t snapshot[NUM_COUNTERS];
+static double snapshot_time;
+
+static int perf_open(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* counter value scaled for multiplexing */
+static uint64_t perf_read(int fd) {
+    uint64_t values[3];
+    if (read(fd, values, sizeof(values)) != sizeof(values) || values[2] == 0) {
+        return 0;
+    }
+    if (values[2] == values[1]) {
+        return values[0];
+    }
+    return (uint64_t)((double)values[0] * values[1] / values[2]);
+}
+
+static void region_begin(void) {
+    for (unsigned i = 0; i < NUM_COUNTERS; ++i) {
+        if (counters[i].fd >= 0) {
+            snapshot[i] = perf_read(counters[i].fd);
+        }
+    }
+    snapshot_time = hashx_time();
+}
+
+static void region_end(int region) {
+    total_time[region] += hashx_time() - snapshot_time;
+    for (unsigned i = 0; i < NUM_COUNTERS; ++i) {
+        if (counters[i].fd >= 0) {
+            totals[region][i] += perf_read(counters[i].fd) - snapshot[i];
+        }
+    }
+}
+
+int bench_perf(int start, int nonces, equix_ctx_flags flags, uint64_t raw_event) {
+    bool any = false;
+    counters[RAW_COUNTER].config = raw_event;
+    for (unsigned i = 0; i < NUM_COUNTERS; ++i) {
+        if (i == RAW_COUNTER && raw_event == 0) {
+            continue;
+        }
+        counters[i].fd = perf_open(counters[i].type, counters[i].config);
+        any |= counters[i].fd >= 0;
+    }
+    if (!any) {
+        printf("Note: no hardware counters available. Check /proc/sys/kernel/perf_event_paranoid\n");
+    }
+    equix_ctx* ctx = equix_alloc(flags);
+    if (ctx == NULL) {
+        printf("Error: memory allocation failure\n");
+        return 1;
+    }
+    if (ctx == EQUIX_NOTSUPP) {
+        printf("Error: not supported. Try with --interpret\n");
+        return 1;
+    }
+    /* --try-compile may have fallen back to the interpreter */
+    equix_ctx_flags ctx_flags = equix_get_flags(ctx);
+    printf("Profiling nonces %i-%i (interpret: %i, hugepages: %i) ...\n",
+        start, start + nonces - 1, (ctx_flags & EQUIX_CTX_COMPILE) == 0,
+        (ctx_flags & EQUIX_CTX_HUGEPAGES) != 0);
+    int total_sols = 0;
+    int valid_nonces = 0;
+    for (int seed = start; seed < start + nonces; ++seed) {
+        equix_solution sols[EQUIX_MAX_SOLS];
+        region_begin();
+        int valid = equix_hook_make(ctx, &seed, sizeof(seed));
+        region_end(REGION_HASHX_MAKE);
+        if (!valid) {
+            continue;
+        }
+        valid_nonces++;
+        region_begin();
+        equix_hook_hash_all(ctx);
+        region_end(REGION_HASHX_EXEC);
+        int count = 0;
+        for (int stage = 0; stage < 4; ++stage) {
+            region_begin();
+            count = equix_hook_stage(ctx, stage, sols);
+            region_end(REGION_STAGE0 + stage);
+        }
+        for (int sol = 0; sol < count; ++sol) {
+            equix_invalidate_hash(ctx); /* measure the full cost of verification */
+            region_begin();
+            equix_result result = equix_verify(ctx, &seed, sizeof(seed), &sols[sol]);
+            region_end(REGION_VERIFY);
+            if (result != EQUIX_OK) {
+                printf("Error: invalid solution for nonce %i\n", seed);
+                return 1;
+            }
+        }
+        total_sols += count;
+    }
+    printf("%-22s %10s", "per nonce", "time (us)");
+    for (unsigned i = 0; i < NUM_COUNTERS; ++i) {
+        if (counters[i].fd >= 0) {
+            printf(" %14s", counters[i].name);
+        }
+    }
+    printf("\n");
+    for (int region = 0; region < NUM_REGIONS; ++region) {
+        double divisor = region == REGION_HASHX_MAKE ? nonces :
+            region == REGION_VERIFY ? total_sols : valid_nonces;
+        printf("%-22s %10.1f", region_names[region],
+            divisor > 0 ? total_time[region] * 1e6 / divisor : 0.0);
+        for (unsigned i = 0; i < NUM_COUNTERS; ++i) {
+            if (counters[i].fd >= 0) {
+                printf(" %14.0f", divisor > 0 ? totals[region][i] / divisor : 0.0);
+            }
+        }
+        printf("\n");
+    }
+    for (unsigned i = 0; i < NUM_COUNTERS; ++i) {
+        if (counters[i].fd >= 0) {
+            close(counters[i].fd);
+        }
+        else if (any && (i != RAW_COUNTER || raw_event != 0)) {
+            printf("Note: counter '%s' is not available\n", counters[i].name);
+        }
+    }
+    equix_free(ctx);
+    return 0;
+}
+
+#else
+
+#include <stdio.h>
+
+int bench_perf(int start, int nonces, equix_ctx_flags flags, uint64_t raw_event) {
+    printf("Error: --perf is only supported on Linux\n");
+    return 1;
+}
+
+#endif
@@ -0,0 +1,20 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#ifndef BENCH_PERF_H
+#define BENCH_PERF_H
+
+#include <stdint.h>
+#include <equix.h>
+
+/*
+ * Solve nonces start to start+nonces-1 and print hardware performance
+ * counters per solver stage, averaged per nonce.
+ *
+ * @param raw_event is an optional raw PMU event code (0 = none)
+ *
+ * @return 0 on success, 1 on failure
+ */
+int bench_perf(int start, int nonces, equix_ctx_flags flags, uint64_t raw_event);
+
+#endif
@@ -0,0 +1,223 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+
+#include <equix.h>
+#include "atomics.h"
+#include "context.h"
+#include "mutex.h"
+
+/*
+ * The cache is split into shards selected by the challenge digest. Each
+ * challenge can be stored in CACHE_WAYS consecutive entries of its shard.
+ * Writers lock the shard. Readers do not lock: every entry is protected by
+ * a sequence counter that is odd while the entry is being written, and a
+ * reader that sees the counter change discards its copy (seqlock).
+ */
+
+#define CACHE_SHARDS 16
+#define CACHE_WAYS 8
+#define CACHE_LINE 64
+
+typedef struct cache_data {
+    bool used;
+    uint32_t challenge_size;
+    int count;
+    uint64_t digest;
+    double time;
+    uint8_t challenge[EQUIX_CACHE_MAX_CHALLENGE];
+    equix_solution sols[EQUIX_MAX_SOLS];
+} cache_data;
+
+typedef struct cache_entry {
+    equix_atomic_int seq;
+    cache_data data;
+} cache_entry;
+
+typedef struct cache_shard {
+    equix_mutex mutex;
+    cache_entry* entries;
+    size_t size;
+    equix_atomic_u64 hits;
+    equix_atomic_u64 misses;
+    equix_atomic_u64 expired;
+    equix_atomic_u64 evictions;
+    char padding[CACHE_LINE];   /* keep the counters of shards apart */
+} cache_shard;
+
+struct equix_cache {
+    double ttl;
+    uint64_t seed;
+    size_t num_shards;
+    cache_shard shards[CACHE_SHARDS];
+    cache_entry* entries;
+};
+
+/* FNV-1a with a per-cache seed */
+static uint64_t challenge_digest(const equix_cache* cache, const void* challenge, size_t size) {
+    const uint8_t* data = (const uint8_t*)challenge;
+    uint64_t hash = UINT64_C(0xcbf29ce484222325) ^ cache->seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * UINT64_C(0x100000001b3);
+    }
+    return hash ^ (hash >> 29);
+}
+
+equix_cache* equix_cache_alloc(size_t capacity, double ttl) {
+    if (capacity == 0) {
+        return NULL;
+    }
+    equix_cache* cache = calloc(1, sizeof(equix_cache));
+    if (cache == NULL) {
+        return NULL;
+    }
+    cache->num_shards = capacity < CACHE_SHARDS * CACHE_WAYS ? 1 : CACHE_SHARDS;
+    for (size_t i = 0; i < cache->num_shards; ++i) {
+        equix_mutex_init(&cache->shards[i].mutex);
+    }
+    cache->ttl = ttl;
+    cache->seed = (uint64_t)(uintptr_t)cache ^ (uint64_t)(equix_time() * 1e9);
+    cache->entries = calloc(capacity, sizeof(cache_entry));
+    if (cache->entries == NULL) {
+        equix_cache_free(cache);
+        return NULL;
+    }
+    cache_entry* next = cache->entries;
+    for (size_t i = 0; i < cache->num_shards; ++i) {
+        cache_shard* shard = &cache->shards[i];
+        shard->size = capacity / cache->num_shards +
+            (i < capacity % cache->num_shards);
+        shard->entries = next;
+        next += shard->size;
+    }
+    return cache;
+}
+
+void equix_cache_free(equix_cache* cache) {
+    if (cache != NULL) {
+        for (size_t i = 0; i < cache->num_shards; ++i) {
+            equix_mutex_destroy(&cache->shards[i].mutex);
+        }
+        free(cache->entries);
+        free(cache);
+    }
+}
+
+/* copies a consistent snapshot of an entry, returns false on a concurrent write */
+static bool entry_read(cache_entry* entry, cache_data* data) {
+    int seq = equix_atomic_load_acquire(&entry->seq);
+    if (seq & 1) {
+        return false;
+    }
+    memcpy(data, &entry->data, sizeof(cache_data));
+    equix_atomic_fence_acquire();
+    return equix_atomic_load(&entry->seq) == seq;
+}
+
+/* must be called with the shard locked */
+static void entry_write(cache_entry* entry, const cache_data* data) {
+    /* the counter wraps at INT_MAX + 1 to stay even */
+    int seq = equix_atomic_load(&entry->seq);
+    int next = seq < INT_MAX - 1 ? seq + 2 : 0;
+    equix_atomic_store(&entry->seq, seq + 1);
+    equix_atomic_fence_release();
+    memcpy(&entry->data, data, sizeof(cache_data));
+    equix_atomic_store_release(&entry->seq, next);
+}
+
+static bool entry_matches(const cache_data* data, uint64_t digest, const void* challenge, size_t size) {
+    return data->used && data->digest == digest && data->challenge_size == size &&
+        memcmp(data->challenge, challenge, size) == 0;
+}
+
+static void cache_insert(
+    cache_shard* shard,
+    size_t first,
+    size_t ways,
+    double now,
+    double ttl,
+    const cache_data* data)
+{
+    equix_mutex_lock(&shard->mutex);
+    /* reuse a matching entry, then an unused or expired one, then the oldest */
+    size_t victim = first;
+    int victim_rank = 3;
+    for (size_t way = 0; way < ways; ++way) {
+        size_t idx = (first + way) % shard->size;
+        const cache_data* current = &shard->entries[idx].data;
+        int rank = entry_matches(current, data->digest, data->challenge, data->challenge_size) ? 0 :
+            !current->used || now - current->time > ttl ? 1 : 2;
+        if (rank < victim_rank ||
+            (rank == 2 && victim_rank == 2 && current->time < shard->entries[victim].data.time)) {
+            victim = idx;
+            victim_rank = rank;
+        }
+    }
+    if (victim_rank == 2) {
+        equix_atomic_add_u64(&shard->evictions, 1);
+    }
+    entry_write(&shard->entries[victim], data);
+    equix_mutex_unlock(&shard->mutex);
+}
+
+int equix_cache_solve(
+    equix_cache* cache,
+    equix_ctx* ctx,
+    const void* challenge,
+    size_t challenge_size,
+    equix_solution output[EQUIX_MAX_SOLS])
+{
+    if (challenge_size > EQUIX_CACHE_MAX_CHALLENGE) {
+        return equix_solve(ctx, challenge, challenge_size, output);
+    }
+    uint64_t digest = challenge_digest(cache, challenge, challenge_size);
+    cache_shard* shard = &cache->shards[digest % cache->num_shards];
+    size_t first = (size_t)(digest / CACHE_SHARDS % shard->size);
+    size_t ways = shard->size < CACHE_WAYS ? shard->size : CACHE_WAYS;
+    double now = equix_time();
+    cache_data data;
+    for (size_t way = 0; way < ways; ++way) {
+        cache_entry* entry = &shard->entries[(first + way) % shard->size];
+        if (!entry_read(entry, &data) ||
+            !entry_matches(&data, digest, challenge, challenge_size)) {
+            continue;
+        }
+        if (now - data.time > cache->ttl) {
+            equix_atomic_add_u64(&shard->expired, 1);
+            break;
+        }
+        equix_atomic_add_u64(&shard->hits, 1);
+        memcpy(output, data.sols, data.count * sizeof(equix_solution));
+        return data.count;
+    }
+    equix_atomic_add_u64(&shard->misses, 1);
+    int count = equix_solve(ctx, challenge, challenge_size, output);
+    if ((ctx->flags & EQUIX_CTX_SOLVE) == 0) {
+        /* "no solutions" from a verifier context is not a result */
+        return count;
+    }
+    data.used = true;
+    data.challenge_size = (uint32_t)challenge_size;
+    data.count = count;
+    data.digest = digest;
+    data.time = equix_time();
+    memcpy(data.challenge, challenge, challenge_size);
+    memcpy(data.sols, output, count * sizeof(equix_solution));
+    cache_insert(shard, first, ways, data.time, cache->ttl, &data);
+    return count;
+}
+
+void equix_cache_get_stats(equix_cache* cache, equix_cache_stats* stats) {
+    memset(stats, 0, sizeof(equix_cache_stats));
+    for (size_t i = 0; i < cache->num_shards; ++i) {
+        cache_shard* shard = &cache->shards[i];
+        stats->hits += equix_atomic_load_u64(&shard->hits);
+        stats->misses += equix_atomic_load_u64(&shard->misses);
+        stats->expired += equix_atomic_load_u64(&shard->expired);
+        stats->evictions += equix_atomic_load_u64(&shard->evictions);
+    }
+}
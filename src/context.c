@@ -2,20 +2,179 @@
 /* See LICENSE for licensing information */
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
 #include <equix.h>
 #include <virtual_memory.h>
 #include "context.h"
+#include "atomics.h"
 #include "solver_heap.h"
 
+#ifdef EQUIX_WIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <time.h>
+#endif
+
+double equix_time(void) {
+#ifdef EQUIX_WIN
+    static double freq = 0;
+    LARGE_INTEGER counter;
+    if (freq == 0) {
+        LARGE_INTEGER f;
+        QueryPerformanceFrequency(&f);
+        freq = (double)f.QuadPart;
+    }
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart / freq;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+/*
+ * Check that the host lets us make a page executable. Hardened systems
+ * (e.g. SELinux with execmem denied) refuse this, and the HashX compiler
+ * would then fail when it switches its code buffer to executable.
+ */
+static int jit_allowed(void) {
+    static equix_atomic_int cached = -1;
+    int result = equix_atomic_load(&cached);
+    if (result >= 0) {
+        return result;
+    }
+    const size_t size = 4096;
+#ifdef EQUIX_WIN
+    void* mem = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    DWORD old_protect;
+    result = mem != NULL &&
+        VirtualProtect(mem, size, PAGE_EXECUTE_READ, &old_protect);
+    if (mem != NULL) {
+        VirtualFree(mem, 0, MEM_RELEASE);
+    }
+#else
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    result = mem != MAP_FAILED &&
+        mprotect(mem, size, PROT_READ | PROT_EXEC) == 0;
+    if (mem != MAP_FAILED) {
+        munmap(mem, size);
+    }
+#endif
+    equix_atomic_store(&cached, result);
+    return result;
+}
+
+#define CALIBRATION_SAMPLES 16
+
+static size_t heap_size_of(equix_ctx_flags flags) {
+    return flags & EQUIX_CTX_LOWMEM ?
+        sizeof(solver_lowmem_heap) : sizeof(solver_heap);
+}
+
+/*
+ * Returns the number of verifications of one challenge after which the
+ * time saved by compiled hashing has paid for compiling the hash function.
+ * The interpreted program has been generated by then, so the compiler has
+ * to repay its whole cost (program generation, code emission and two
+ * mprotect calls). Measured once per process.
+ */
+static unsigned compile_threshold(hashx_ctx* compiled, hashx_ctx* interpreted) {
+    static equix_atomic_int cached = 0;
+    unsigned result = (unsigned)equix_atomic_load(&cached);
+    if (result > 0) {
+        return result;
+    }
+    hashx_ctx* funcs[2] = { interpreted, compiled };
+    double make_time[2] = { 0, 0 };
+    double exec_time[2] = { 0, 0 };
+    for (int type = 0; type < 2; ++type) {
+        for (uint32_t seed = 0; seed < CALIBRATION_SAMPLES; ++seed) {
+            uint8_t hash[HASHX_SIZE];
+            double start = equix_time();
+            int valid = hashx_make(funcs[type], &seed, sizeof(seed));
+            double made = equix_time();
+            if (!valid) {
+                continue;
+            }
+            /* one solution needs 8 hashes */
+            for (uint64_t i = 0; i < 8; ++i) {
+                hashx_exec(funcs[type], i, hash);
+            }
+            make_time[type] += made - start;
+            exec_time[type] += equix_time() - made;
+        }
+    }
+    double saving = exec_time[0] - exec_time[1];
+    if (saving <= 0) {
+        result = INT_MAX;
+    }
+    else if (make_time[1] <= saving) {
+        result = 1;
+    }
+    else {
+        double threshold = make_time[1] / saving + 1;
+        result = threshold < INT_MAX ? (unsigned)threshold : INT_MAX;
+    }
+    equix_atomic_store(&cached, (int)result);
+    return result;
+}
+
 equix_ctx* equix_alloc(equix_ctx_flags flags) {
     equix_ctx* ctx_failure = NULL;
     equix_ctx* ctx = malloc(sizeof(equix_ctx));
     if (ctx == NULL) {
         goto failure;
     }
+    bool profile_hugepages = false;
+    if (flags & EQUIX_CTX_PROFILE) {
+        equix_ctx_flags requested = flags;
+        flags = equix_profile_apply(flags);
+        profile_hugepages = (flags & ~requested & EQUIX_CTX_HUGEPAGES) != 0;
+    }
+    if (flags & EQUIX_CTX_AUTO_COMPILE) {
+        if (flags & EQUIX_CTX_SOLVE) {
+            flags &= ~EQUIX_CTX_AUTO_COMPILE;
+        }
+        else {
+            flags |= EQUIX_CTX_TRY_COMPILE;
+        }
+    }
+    if (flags & EQUIX_CTX_TRY_COMPILE) {
+        if (jit_allowed()) {
+            flags |= EQUIX_CTX_COMPILE;
+        }
+        else {
+            flags &= ~EQUIX_CTX_COMPILE;
+        }
+    }
+    hashx_type hash_type = flags & EQUIX_CTX_COMPILE ?
+        HASHX_COMPILED : HASHX_INTERPRETED;
     ctx->flags = flags & EQUIX_CTX_COMPILE;
-    ctx->hash_func = hashx_alloc(flags & EQUIX_CTX_COMPILE ?
-        HASHX_COMPILED : HASHX_INTERPRETED);
+    ctx->hash_prep[0] = ctx->hash_prep[1] = NULL;
+    ctx->heap = NULL;
+    ctx->lowmem_heap = NULL;
+    ctx->prep_valid[0] = ctx->prep_valid[1] = 0;
+    ctx->prep_count = ctx->solve_count = 0;
+    ctx->hashes_valid = 0;
+    ctx->hash_interp = NULL;
+    ctx->last_compiled = 0;
+    ctx->last_repeats = 0;
+    ctx->compile_threshold = 0;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->last_size = SIZE_MAX;
+    ctx->hash_func = hashx_alloc(hash_type);
+    if (ctx->hash_func == HASHX_NOTSUPP && (flags & EQUIX_CTX_TRY_COMPILE)) {
+        flags &= ~EQUIX_CTX_COMPILE;
+        ctx->flags = 0;
+        hash_type = HASHX_INTERPRETED;
+        ctx->hash_func = hashx_alloc(hash_type);
+    }
     if (ctx->hash_func == NULL) {
         goto failure;
     }
@@ -23,16 +182,38 @@ equix_ctx* equix_alloc(equix_ctx_flags flags) {
         ctx_failure = EQUIX_NOTSUPP;
         goto failure;
     }
+    if (hash_type == HASHX_INTERPRETED) {
+        flags &= ~EQUIX_CTX_AUTO_COMPILE;
+    }
+    if (flags & EQUIX_CTX_AUTO_COMPILE) {
+        ctx->hash_interp = hashx_alloc(HASHX_INTERPRETED);
+        if (ctx->hash_interp == NULL) {
+            goto failure;
+        }
+        ctx->compile_threshold = compile_threshold(ctx->hash_func, ctx->hash_interp);
+    }
     if (flags & EQUIX_CTX_SOLVE) {
+        size_t heap_size = heap_size_of(flags);
+        void* heap = NULL;
         if (flags & EQUIX_CTX_HUGEPAGES) {
-            ctx->heap = hashx_vm_alloc_huge(sizeof(solver_heap));
+            heap = hashx_vm_alloc_huge(heap_size);
+            if (heap == NULL && profile_hugepages) {
+                /* the profile is stale, e.g. huge pages are no longer reserved */
+                flags &= ~EQUIX_CTX_HUGEPAGES;
+            }
         }
-        else {
-            ctx->heap = malloc(sizeof(solver_heap));
+        if ((flags & EQUIX_CTX_HUGEPAGES) == 0) {
+            heap = malloc(heap_size);
         }
-        if (ctx->heap == NULL) {
+        if (heap == NULL) {
             goto failure;
         }
+        if (flags & EQUIX_CTX_LOWMEM) {
+            ctx->lowmem_heap = heap;
+        }
+        else {
+            ctx->heap = heap;
+        }
     }
     ctx->flags = flags;
     return ctx;
@@ -41,16 +222,29 @@ failure:
     return ctx_failure;
 }
 
+equix_ctx_flags equix_get_flags(const equix_ctx* ctx) {
+    return ctx->flags;
+}
+
+void equix_get_verify_stats(const equix_ctx* ctx, equix_verify_stats* stats) {
+    *stats = ctx->stats;
+}
+
 void equix_free(equix_ctx* ctx) {
     if (ctx != NULL && ctx != EQUIX_NOTSUPP) {
         if (ctx->flags & EQUIX_CTX_SOLVE) {
+            void* heap = ctx->flags & EQUIX_CTX_LOWMEM ?
+                (void*)ctx->lowmem_heap : (void*)ctx->heap;
             if (ctx->flags & EQUIX_CTX_HUGEPAGES) {
-                hashx_vm_free(ctx->heap, sizeof(solver_heap));
+                hashx_vm_free(heap, heap_size_of(ctx->flags));
             }
             else {
-                free(ctx->heap);
+                free(heap);
             }
         }
+        hashx_free(ctx->hash_prep[0]);
+        hashx_free(ctx->hash_prep[1]);
+        hashx_free(ctx->hash_interp);
         hashx_free(ctx->hash_func);
         free(ctx);
     }
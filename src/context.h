@@ -7,12 +7,38 @@
 #include <equix.h>
 #include <hashx.h>
 
+/* Repeat-challenge cache: challenges up to this size are remembered to
+   skip rebuilding the hash function for the same challenge */
+#define EQUIX_CACHED_CHALLENGE 128
+
 typedef struct solver_heap solver_heap;
+typedef struct solver_lowmem_heap solver_lowmem_heap;
 
 typedef struct equix_ctx {
     hashx_ctx* hash_func;
     solver_heap* heap;
+    solver_lowmem_heap* lowmem_heap; /* used instead of heap with EQUIX_CTX_LOWMEM */
     equix_ctx_flags flags;
+    hashx_ctx* hash_prep[2];  /* double buffer for prepared challenges */
+    int prep_valid[2];
+    unsigned prep_count;      /* written only by equix_prepare */
+    unsigned solve_count;     /* written only by equix_solve_prepared */
+    int hashes_valid;         /* heap holds the output of equix_solve_hashes */
+    size_t last_size;         /* challenge currently loaded in hash_func */
+    int last_valid;
+    uint8_t last_challenge[EQUIX_CACHED_CHALLENGE];
+    hashx_ctx* hash_interp;   /* EQUIX_CTX_AUTO_COMPILE: interpreter, while
+                                 hash_func is compiled */
+    int last_compiled;        /* hash_func holds the last challenge */
+    unsigned last_repeats;    /* verifications of the last challenge */
+    unsigned compile_threshold; /* compile at this many verifications */
+    equix_verify_stats stats;
 } equix_ctx;
 
+/* Monotonic time in seconds */
+EQUIX_PRIVATE double equix_time(void);
+
+/* Applies the host profile to flags of contexts with EQUIX_CTX_PROFILE */
+EQUIX_PRIVATE equix_ctx_flags equix_profile_apply(equix_ctx_flags flags);
+
 #endif
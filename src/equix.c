@@ -8,7 +8,9 @@
 #include <equix.h>
 #include <hashx.h>
 #include "context.h"
+#include "hooks.h"
 #include "solver.h"
+#include "trace.h"
 #include <hashx_endian.h>
 
 static bool verify_order(const equix_solution* solution) {
@@ -30,38 +32,127 @@ static uint64_t sum_pair(hashx_ctx* hash_func, equix_idx left, equix_idx right)
     return load64(hash_left) + load64(hash_right);
 }
 
-static equix_result verify_internal(hashx_ctx* hash_func, const equix_solution* solution) {
+/* step identifies the failed check for the verify_exit probe */
+#define VERIFY_EXIT(step, result)                     \
+    do {                                              \
+        EQUIX_PROBE3(verify_exit, ctx, step, result); \
+        return result;                                \
+    } while (0)
+
+static equix_result verify_internal(const equix_ctx* ctx, hashx_ctx* hash_func, const equix_solution* solution) {
     uint64_t pair0 = sum_pair(hash_func, solution->idx[0], solution->idx[1]);
     if (pair0 & EQUIX_STAGE1_MASK) {
-        return EQUIX_PARTIAL_SUM;
+        VERIFY_EXIT(0, EQUIX_PARTIAL_SUM);
     }
     uint64_t pair1 = sum_pair(hash_func, solution->idx[2], solution->idx[3]);
     if (pair1 & EQUIX_STAGE1_MASK) {
-        return EQUIX_PARTIAL_SUM;
+        VERIFY_EXIT(1, EQUIX_PARTIAL_SUM);
     }
     uint64_t pair4 = pair0 + pair1;
     if (pair4 & EQUIX_STAGE2_MASK) {
-        return EQUIX_PARTIAL_SUM;
+        VERIFY_EXIT(2, EQUIX_PARTIAL_SUM);
     }
     uint64_t pair2 = sum_pair(hash_func, solution->idx[4], solution->idx[5]);
     if (pair2 & EQUIX_STAGE1_MASK) {
-        return EQUIX_PARTIAL_SUM;
+        VERIFY_EXIT(3, EQUIX_PARTIAL_SUM);
     }
     uint64_t pair3 = sum_pair(hash_func, solution->idx[6], solution->idx[7]);
     if (pair3 & EQUIX_STAGE1_MASK) {
-        return EQUIX_PARTIAL_SUM;
+        VERIFY_EXIT(4, EQUIX_PARTIAL_SUM);
     }
     uint64_t pair5 = pair2 + pair3;
     if (pair5 & EQUIX_STAGE2_MASK) {
-        return EQUIX_PARTIAL_SUM;
+        VERIFY_EXIT(5, EQUIX_PARTIAL_SUM);
     }
     uint64_t pair6 = pair4 + pair5;
     if (pair6 & EQUIX_FULL_MASK) {
-        return EQUIX_FINAL_SUM;
+        VERIFY_EXIT(6, EQUIX_FINAL_SUM);
     }
     return EQUIX_OK;
 }
 
+void equix_invalidate_hash(equix_ctx* ctx) {
+    ctx->last_size = SIZE_MAX;
+}
+
+/*
+ * Generate the hash function for a challenge unless it is already loaded
+ * (the repeat-challenge cache). A compiled hash function is recompiled on
+ * every hashx_make call, which costs two mprotect calls, so repeated
+ * challenges (several solutions of one challenge, or verifying a solution
+ * right after solving) are skipped. A new challenge still pays both calls.
+ */
+static int make_hash_func(equix_ctx* ctx, const void* challenge, size_t challenge_size) {
+    if (challenge_size == ctx->last_size &&
+        memcmp(challenge, ctx->last_challenge, challenge_size) == 0) {
+        return ctx->last_valid;
+    }
+    int valid = traced_make(ctx, ctx->hash_func, challenge, challenge_size);
+    if (challenge_size <= EQUIX_CACHED_CHALLENGE) {
+        memcpy(ctx->last_challenge, challenge, challenge_size);
+        ctx->last_size = challenge_size;
+        ctx->last_valid = valid;
+    }
+    else {
+        ctx->last_size = SIZE_MAX;
+    }
+    return valid;
+}
+
+/*
+ * Select the hash function for verifying solutions of a challenge.
+ * With EQUIX_CTX_AUTO_COMPILE, a challenge is interpreted until it has
+ * been verified compile_threshold times (counting the solutions of the
+ * current batch), then it is compiled. Returns NULL for invalid challenges.
+ */
+static hashx_ctx* verify_hash_func(equix_ctx* ctx, const void* challenge, size_t challenge_size, size_t count) {
+    if ((ctx->flags & EQUIX_CTX_AUTO_COMPILE) == 0) {
+        if (!make_hash_func(ctx, challenge, challenge_size)) {
+            return NULL;
+        }
+        if (ctx->flags & EQUIX_CTX_COMPILE) {
+            ctx->stats.compiled += count;
+        }
+        else {
+            ctx->stats.interpreted += count;
+        }
+        return ctx->hash_func;
+    }
+    bool repeated = challenge_size == ctx->last_size &&
+        memcmp(challenge, ctx->last_challenge, challenge_size) == 0;
+    if (!repeated) {
+        /* compile right away if this call alone reaches the threshold */
+        ctx->last_compiled = count >= ctx->compile_threshold;
+        ctx->last_repeats = 0;
+        ctx->last_valid = traced_make(ctx,
+            ctx->last_compiled ? ctx->hash_func : ctx->hash_interp,
+            challenge, challenge_size);
+        ctx->stats.compilations += ctx->last_compiled;
+        if (challenge_size <= EQUIX_CACHED_CHALLENGE) {
+            memcpy(ctx->last_challenge, challenge, challenge_size);
+            ctx->last_size = challenge_size;
+        }
+        else {
+            ctx->last_size = SIZE_MAX;
+        }
+    }
+    if (!ctx->last_valid) {
+        return NULL;
+    }
+    ctx->last_repeats += (unsigned)count;
+    if (!ctx->last_compiled && ctx->last_repeats >= ctx->compile_threshold) {
+        traced_make(ctx, ctx->hash_func, challenge, challenge_size);
+        ctx->last_compiled = 1;
+        ctx->stats.compilations++;
+    }
+    if (ctx->last_compiled) {
+        ctx->stats.compiled += count;
+        return ctx->hash_func;
+    }
+    ctx->stats.interpreted += count;
+    return ctx->hash_interp;
+}
+
 int equix_solve(
     equix_ctx* ctx,
     const void* challenge,
@@ -72,13 +163,83 @@ int equix_solve(
         return 0;
     }
 
-    if (!hashx_make(ctx->hash_func, challenge, challenge_size)) {
+    if (!make_hash_func(ctx, challenge, challenge_size)) {
+        return 0;
+    }
+
+    return solver_run(ctx, ctx->hash_func, output, NULL);
+}
+
+int equix_prepare(
+    equix_ctx* ctx,
+    const void* challenge,
+    size_t challenge_size)
+{
+    if ((ctx->flags & EQUIX_CTX_SOLVE) == 0) {
+        return 0;
+    }
+
+    unsigned slot = ctx->prep_count++ % 2;
+    if (ctx->hash_prep[slot] == NULL) {
+        /* allocated on first use, most solver contexts never prepare */
+        hashx_ctx* hash_func = hashx_alloc(ctx->flags & EQUIX_CTX_COMPILE ?
+            HASHX_COMPILED : HASHX_INTERPRETED);
+        if (hash_func == NULL || hash_func == HASHX_NOTSUPP) {
+            ctx->prep_valid[slot] = 0;
+            return 0;
+        }
+        ctx->hash_prep[slot] = hash_func;
+    }
+    ctx->prep_valid[slot] =
+        traced_make(ctx, ctx->hash_prep[slot], challenge, challenge_size);
+    return ctx->prep_valid[slot];
+}
+
+int equix_solve_prepared(
+    equix_ctx* ctx,
+    equix_solution output[EQUIX_MAX_SOLS])
+{
+    if ((ctx->flags & EQUIX_CTX_SOLVE) == 0) {
+        return 0;
+    }
+
+    unsigned slot = ctx->solve_count++ % 2;
+    if (!ctx->prep_valid[slot]) {
+        return 0;
+    }
+
+    return solver_run(ctx, ctx->hash_prep[slot], output, NULL);
+}
+
+int equix_solve_hashes(
+    equix_ctx* ctx,
+    const void* challenge,
+    size_t challenge_size)
+{
+    if ((ctx->flags & EQUIX_CTX_SOLVE) == 0) {
         return 0;
     }
 
-    return equix_solver_solve(ctx->hash_func, ctx->heap, output);
+    ctx->hashes_valid = make_hash_func(ctx, challenge, challenge_size);
+    if (ctx->hashes_valid) {
+        solver_run_stage(ctx, 0, ctx->hash_func, NULL);
+    }
+    return ctx->hashes_valid;
 }
 
+int equix_solve_pairs(
+    equix_ctx* ctx,
+    equix_solution output[EQUIX_MAX_SOLS])
+{
+    if ((ctx->flags & EQUIX_CTX_SOLVE) == 0 || !ctx->hashes_valid) {
+        return 0;
+    }
+
+    ctx->hashes_valid = 0;
+    solver_run_stage(ctx, 1, ctx->hash_func, output);
+    solver_run_stage(ctx, 2, ctx->hash_func, output);
+    return solver_run_stage(ctx, 3, ctx->hash_func, output);
+}
 
 equix_result equix_verify(
     equix_ctx* ctx,
@@ -86,11 +247,105 @@ equix_result equix_verify(
     size_t challenge_size,
     const equix_solution* solution)
 {
+    EQUIX_PROBE2(verify_start, ctx, EQUIX_TRACE_DIGEST(verify_start, challenge, challenge_size));
+    equix_result result;
     if (!verify_order(solution)) {
-        return EQUIX_ORDER;
+        result = EQUIX_ORDER;
+    }
+    else {
+        hashx_ctx* hash_func = verify_hash_func(ctx, challenge, challenge_size, 1);
+        result = hash_func == NULL ? EQUIX_CHALLENGE :
+            verify_internal(ctx, hash_func, solution);
+    }
+    EQUIX_PROBE2(verify_done, ctx, result);
+    return result;
+}
+
+size_t equix_verify_batch(
+    equix_ctx* ctx,
+    const void* challenge,
+    size_t challenge_size,
+    const equix_solution solutions[],
+    size_t count,
+    equix_result results[])
+{
+    /* every solution gets its own verify_start and verify_done probes */
+    uint64_t digest = EQUIX_TRACE_DIGEST(verify_start, challenge, challenge_size);
+    size_t ordered = 0;
+    for (size_t i = 0; i < count; ++i) {
+        results[i] = verify_order(&solutions[i]) ? EQUIX_OK : EQUIX_ORDER;
+        if (results[i] == EQUIX_ORDER) {
+            EQUIX_PROBE2(verify_start, ctx, digest);
+            EQUIX_PROBE2(verify_done, ctx, results[i]);
+        }
+        ordered += results[i] == EQUIX_OK;
+    }
+    if (ordered == 0) {
+        return 0;
+    }
+    hashx_ctx* hash_func = verify_hash_func(ctx, challenge, challenge_size, ordered);
+    size_t valid = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (results[i] == EQUIX_OK) {
+            EQUIX_PROBE2(verify_start, ctx, digest);
+            results[i] = hash_func == NULL ? EQUIX_CHALLENGE :
+                verify_internal(ctx, hash_func, &solutions[i]);
+            EQUIX_PROBE2(verify_done, ctx, results[i]);
+            valid += results[i] == EQUIX_OK;
+        }
     }
-    if (!hashx_make(ctx->hash_func, challenge, challenge_size)) {
+    return valid;
+}
+
+int equix_prefix_init(equix_prefix* prefix, const void* data, size_t size) {
+    if (size > EQUIX_MAX_PREFIX) {
+        return 0;
+    }
+    memcpy(prefix->data, data, size);
+    prefix->size = size;
+    return 1;
+}
+
+size_t equix_prefix_challenge(
+    const equix_prefix* prefix,
+    const void* suffix,
+    size_t suffix_size,
+    uint8_t output[EQUIX_MAX_PREFIXED_CHALLENGE])
+{
+    if (suffix_size > EQUIX_MAX_PREFIXED_CHALLENGE - prefix->size) {
+        return 0;
+    }
+    memcpy(output, prefix->data, prefix->size);
+    memcpy(output + prefix->size, suffix, suffix_size);
+    return prefix->size + suffix_size;
+}
+
+int equix_solve_suffix(
+    equix_ctx* ctx,
+    const equix_prefix* prefix,
+    const void* suffix,
+    size_t suffix_size,
+    equix_solution output[EQUIX_MAX_SOLS])
+{
+    uint8_t challenge[EQUIX_MAX_PREFIXED_CHALLENGE];
+    size_t size = equix_prefix_challenge(prefix, suffix, suffix_size, challenge);
+    if (size == 0) {
+        return 0;
+    }
+    return equix_solve(ctx, challenge, size, output);
+}
+
+equix_result equix_verify_suffix(
+    equix_ctx* ctx,
+    const equix_prefix* prefix,
+    const void* suffix,
+    size_t suffix_size,
+    const equix_solution* solution)
+{
+    uint8_t challenge[EQUIX_MAX_PREFIXED_CHALLENGE];
+    size_t size = equix_prefix_challenge(prefix, suffix, suffix_size, challenge);
+    if (size == 0) {
         return EQUIX_CHALLENGE;
     }
-    return verify_internal(ctx->hash_func, solution);
+    return equix_verify(ctx, challenge, size, solution);
 }
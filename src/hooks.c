@@ -0,0 +1,31 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include <equix.h>
+#include <hashx.h>
+#include "context.h"
+#include "hooks.h"
+#include "solver.h"
+#include "solver_heap.h"
+#include "trace.h"
+
+int equix_hook_make(equix_ctx* ctx, const void* challenge, size_t challenge_size) {
+    equix_invalidate_hash(ctx);
+    return traced_make(ctx, ctx->hash_func, challenge, challenge_size);
+}
+
+void equix_hook_hash_all(equix_ctx* ctx) {
+    uint8_t hash[HASHX_SIZE];
+    for (uint32_t i = 0; i < INDEX_SPACE; ++i) {
+        hashx_exec(ctx->hash_func, i, hash);
+    }
+}
+
+int equix_hook_stage(equix_ctx* ctx, int stage, equix_solution output[EQUIX_MAX_SOLS]) {
+    return solver_run_stage(ctx, stage, ctx->hash_func, output);
+}
+
+size_t equix_hook_heap_size(equix_ctx_flags flags) {
+    return flags & EQUIX_CTX_LOWMEM ?
+        sizeof(solver_lowmem_heap) : sizeof(solver_heap);
+}
@@ -0,0 +1,32 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#ifndef HOOKS_H
+#define HOOKS_H
+
+#include <stddef.h>
+#include <equix.h>
+
+/*
+ * Internal entry points for equix-bench, which times the parts of solving
+ * and verification separately. They are not part of the API. The tools use
+ * only these, so they do not depend on the layout of equix_ctx.
+ */
+
+/* Forgets the challenge loaded in the hash function of a context, so the
+   next one is always generated from scratch */
+EQUIX_PRIVATE void equix_invalidate_hash(equix_ctx* ctx);
+
+/* Generates the hash function of a solver context for a challenge */
+EQUIX_PRIVATE int equix_hook_make(equix_ctx* ctx, const void* challenge, size_t challenge_size);
+
+/* Evaluates the hash function for the whole index space */
+EQUIX_PRIVATE void equix_hook_hash_all(equix_ctx* ctx);
+
+/* Runs a single solver stage (0-3) for the generated hash function */
+EQUIX_PRIVATE int equix_hook_stage(equix_ctx* ctx, int stage, equix_solution output[EQUIX_MAX_SOLS]);
+
+/* Size of the solver heap of a context with the given flags */
+EQUIX_PRIVATE size_t equix_hook_heap_size(equix_ctx_flags flags);
+
+#endif
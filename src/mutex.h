@@ -0,0 +1,49 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include <equix.h>
+
+#ifdef EQUIX_WIN
+#include <windows.h>
+typedef CRITICAL_SECTION equix_mutex;
+
+static inline void equix_mutex_init(equix_mutex* mutex) {
+    InitializeCriticalSection(mutex);
+}
+
+static inline void equix_mutex_destroy(equix_mutex* mutex) {
+    DeleteCriticalSection(mutex);
+}
+
+static inline void equix_mutex_lock(equix_mutex* mutex) {
+    EnterCriticalSection(mutex);
+}
+
+static inline void equix_mutex_unlock(equix_mutex* mutex) {
+    LeaveCriticalSection(mutex);
+}
+#else
+#include <pthread.h>
+typedef pthread_mutex_t equix_mutex;
+
+static inline void equix_mutex_init(equix_mutex* mutex) {
+    pthread_mutex_init(mutex, NULL);
+}
+
+static inline void equix_mutex_destroy(equix_mutex* mutex) {
+    pthread_mutex_destroy(mutex);
+}
+
+static inline void equix_mutex_lock(equix_mutex* mutex) {
+    pthread_mutex_lock(mutex);
+}
+
+static inline void equix_mutex_unlock(equix_mutex* mutex) {
+    pthread_mutex_unlock(mutex);
+}
+#endif
+
+#endif
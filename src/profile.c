@@ -0,0 +1,141 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <equix.h>
+#include "atomics.h"
+#include "context.h"
+
+#define PROFILE_FLAGS (EQUIX_CTX_COMPILE | EQUIX_CTX_HUGEPAGES)
+
+/* bits of the cached profile */
+#define PROFILE_CACHED 0x10000
+#define PROFILE_FOUND 0x20000
+
+/* solutions per second of one configuration, 0 if not available */
+static double measure(equix_ctx_flags flags, double seconds) {
+    equix_ctx* ctx = equix_alloc(flags);
+    if (ctx == NULL || ctx == EQUIX_NOTSUPP) {
+        return 0;
+    }
+    equix_solution output[EQUIX_MAX_SOLS];
+    int total_sols = 0;
+    uint32_t nonce = 0;
+    double start = equix_time();
+    double elapsed;
+    do {
+        total_sols += equix_solve(ctx, &nonce, sizeof(nonce), output);
+        nonce++;
+        elapsed = equix_time() - start;
+    } while (elapsed < seconds);
+    equix_free(ctx);
+    return total_sols / elapsed;
+}
+
+int equix_tune(equix_profile* profile, double seconds) {
+    equix_ctx_flags candidates[4];
+    int num_candidates = 0;
+    equix_ctx* probe = equix_alloc(EQUIX_CTX_VERIFY | EQUIX_CTX_TRY_COMPILE);
+    bool compile = probe != NULL && probe != EQUIX_NOTSUPP &&
+        (equix_get_flags(probe) & EQUIX_CTX_COMPILE);
+    equix_free(probe);
+    if (compile) {
+        candidates[num_candidates++] = EQUIX_CTX_COMPILE | EQUIX_CTX_HUGEPAGES;
+        candidates[num_candidates++] = EQUIX_CTX_COMPILE;
+    }
+    candidates[num_candidates++] = EQUIX_CTX_HUGEPAGES;
+    candidates[num_candidates++] = 0;
+    profile->flags = 0;
+    profile->threads = 0;
+    profile->solutions_per_sec = 0;
+    for (int i = 0; i < num_candidates; ++i) {
+        double rate = measure(EQUIX_CTX_SOLVE | candidates[i],
+            seconds / num_candidates);
+        if (rate > profile->solutions_per_sec) {
+            profile->flags = candidates[i];
+            profile->solutions_per_sec = rate;
+        }
+    }
+    return profile->solutions_per_sec > 0;
+}
+
+int equix_profile_save(const equix_profile* profile, const char* path) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        return 0;
+    }
+    fprintf(f, "compile=%i\n", (profile->flags & EQUIX_CTX_COMPILE) != 0);
+    fprintf(f, "hugepages=%i\n", (profile->flags & EQUIX_CTX_HUGEPAGES) != 0);
+    fprintf(f, "threads=%i\n", profile->threads);
+    fprintf(f, "solutions_per_sec=%f\n", profile->solutions_per_sec);
+    return fclose(f) == 0;
+}
+
+int equix_profile_load(equix_profile* profile, const char* path) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+    char line[128];
+    int compile = 0, hugepages = 0, threads = 0;
+    bool has_compile = false, has_hugepages = false;
+    double rate = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "compile=%i", &compile) == 1) {
+            has_compile = true;
+        }
+        else if (sscanf(line, "hugepages=%i", &hugepages) == 1) {
+            has_hugepages = true;
+        }
+        else if (sscanf(line, "threads=%i", &threads) == 1 ||
+            sscanf(line, "solutions_per_sec=%lf", &rate) == 1) {
+            continue;
+        }
+    }
+    fclose(f);
+    /* not a profile, e.g. EQUIX_PROFILE names the wrong file */
+    if (!has_compile || !has_hugepages) {
+        return 0;
+    }
+    profile->flags = (compile ? EQUIX_CTX_COMPILE : 0) |
+        (hugepages ? EQUIX_CTX_HUGEPAGES : 0);
+    profile->threads = threads;
+    profile->solutions_per_sec = rate;
+    return 1;
+}
+
+/* the profile flags, read from the file once per process */
+static int profile_flags(void) {
+    static equix_atomic_int cached = 0;
+    int result = equix_atomic_load(&cached);
+    if (result & PROFILE_CACHED) {
+        return result;
+    }
+    const char* path = getenv("EQUIX_PROFILE");
+    equix_profile profile;
+    result = PROFILE_CACHED;
+    if (path != NULL && equix_profile_load(&profile, path)) {
+        result |= PROFILE_FOUND | (profile.flags & PROFILE_FLAGS);
+    }
+    equix_atomic_store(&cached, result);
+    return result;
+}
+
+equix_ctx_flags equix_profile_apply(equix_ctx_flags flags) {
+    int profile = profile_flags();
+    if ((profile & PROFILE_FOUND) == 0) {
+        return flags;
+    }
+    flags &= ~PROFILE_FLAGS;
+    flags |= profile & PROFILE_FLAGS;
+    if (flags & EQUIX_CTX_COMPILE) {
+        /* the profile may be stale, e.g. after JIT was forbidden */
+        flags |= EQUIX_CTX_TRY_COMPILE;
+    }
+    else {
+        flags &= ~EQUIX_CTX_TRY_COMPILE;
+    }
+    return flags;
+}
@@ -0,0 +1,242 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <equix.h>
+#include "mutex.h"
+
+/*
+ * Every entry is kept in two intrusive binary heaps: a max-heap that
+ * gives the next entry to verify and a min-heap that gives the next entry
+ * to evict. Both heaps store entry indices and every entry remembers its
+ * position in each heap, so any entry can be removed in O(log n).
+ */
+
+enum {
+    HEAP_MAX,
+    HEAP_MIN
+};
+
+typedef struct queue_entry {
+    uint32_t effort;
+    uint32_t challenge_size;
+    uint64_t seq;
+    uint64_t tag;
+    uint32_t heap_pos[2];
+    equix_solution solution;
+} queue_entry;
+
+struct equix_queue {
+    equix_mutex mutex;
+    size_t capacity;
+    size_t max_challenge;
+    size_t count;
+    uint64_t next_seq;
+    equix_queue_stats stats;
+    queue_entry* entries;
+    uint8_t* challenges;
+    uint32_t* heaps[2];
+    uint32_t* free_list;
+};
+
+/*
+ * Returns true if entry a should be verified before entry b.
+ * Equal efforts are ordered first in, first out.
+ */
+static bool entry_before(const queue_entry* a, const queue_entry* b) {
+    if (a->effort != b->effort) {
+        return a->effort > b->effort;
+    }
+    return a->seq < b->seq;
+}
+
+static bool heap_less(equix_queue* queue, int heap, uint32_t a, uint32_t b) {
+    const queue_entry* ea = &queue->entries[a];
+    const queue_entry* eb = &queue->entries[b];
+    return heap == HEAP_MAX ? entry_before(ea, eb) : entry_before(eb, ea);
+}
+
+static void heap_set(equix_queue* queue, int heap, size_t pos, uint32_t idx) {
+    queue->heaps[heap][pos] = idx;
+    queue->entries[idx].heap_pos[heap] = (uint32_t)pos;
+}
+
+static void heap_sift_up(equix_queue* queue, int heap, size_t pos) {
+    uint32_t idx = queue->heaps[heap][pos];
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+        uint32_t parent_idx = queue->heaps[heap][parent];
+        if (!heap_less(queue, heap, idx, parent_idx)) {
+            break;
+        }
+        heap_set(queue, heap, pos, parent_idx);
+        pos = parent;
+    }
+    heap_set(queue, heap, pos, idx);
+}
+
+static void heap_sift_down(equix_queue* queue, int heap, size_t pos) {
+    uint32_t idx = queue->heaps[heap][pos];
+    for (;;) {
+        size_t child = 2 * pos + 1;
+        if (child >= queue->count) {
+            break;
+        }
+        if (child + 1 < queue->count &&
+            heap_less(queue, heap, queue->heaps[heap][child + 1], queue->heaps[heap][child])) {
+            child++;
+        }
+        uint32_t child_idx = queue->heaps[heap][child];
+        if (!heap_less(queue, heap, child_idx, idx)) {
+            break;
+        }
+        heap_set(queue, heap, pos, child_idx);
+        pos = child;
+    }
+    heap_set(queue, heap, pos, idx);
+}
+
+/* must be called before queue->count is decremented */
+static void heap_remove(equix_queue* queue, int heap, size_t pos) {
+    size_t last = queue->count - 1;
+    if (pos != last) {
+        heap_set(queue, heap, pos, queue->heaps[heap][last]);
+        queue->count--;
+        heap_sift_down(queue, heap, pos);
+        heap_sift_up(queue, heap, pos);
+        queue->count++;
+    }
+}
+
+static void queue_remove(equix_queue* queue, uint32_t idx) {
+    heap_remove(queue, HEAP_MAX, queue->entries[idx].heap_pos[HEAP_MAX]);
+    heap_remove(queue, HEAP_MIN, queue->entries[idx].heap_pos[HEAP_MIN]);
+    queue->count--;
+    queue->free_list[queue->capacity - queue->count - 1] = idx;
+}
+
+equix_queue* equix_queue_alloc(size_t capacity, size_t max_challenge) {
+    if (capacity == 0 || capacity > UINT32_MAX ||
+        max_challenge > EQUIX_QUEUE_MAX_CHALLENGE) {
+        return NULL;
+    }
+    equix_queue* queue = calloc(1, sizeof(equix_queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    equix_mutex_init(&queue->mutex);
+    queue->capacity = capacity;
+    queue->max_challenge = max_challenge;
+    queue->entries = malloc(capacity * sizeof(queue_entry));
+    queue->challenges = malloc(capacity * max_challenge + 1);
+    queue->heaps[HEAP_MAX] = malloc(capacity * sizeof(uint32_t));
+    queue->heaps[HEAP_MIN] = malloc(capacity * sizeof(uint32_t));
+    queue->free_list = malloc(capacity * sizeof(uint32_t));
+    if (queue->entries == NULL || queue->challenges == NULL ||
+        queue->heaps[HEAP_MAX] == NULL || queue->heaps[HEAP_MIN] == NULL ||
+        queue->free_list == NULL) {
+        equix_queue_free(queue);
+        return NULL;
+    }
+    /* free_list[0 .. capacity-count-1] holds the unused entries */
+    for (size_t i = 0; i < capacity; ++i) {
+        queue->free_list[i] = (uint32_t)(capacity - 1 - i);
+    }
+    return queue;
+}
+
+void equix_queue_free(equix_queue* queue) {
+    if (queue != NULL) {
+        equix_mutex_destroy(&queue->mutex);
+        free(queue->entries);
+        free(queue->challenges);
+        free(queue->heaps[HEAP_MAX]);
+        free(queue->heaps[HEAP_MIN]);
+        free(queue->free_list);
+        free(queue);
+    }
+}
+
+int equix_queue_push(
+    equix_queue* queue,
+    const void* challenge,
+    size_t challenge_size,
+    const equix_solution* solution,
+    uint32_t effort,
+    uint64_t tag,
+    uint64_t* evicted_tag)
+{
+    int admitted = 1;
+    equix_mutex_lock(&queue->mutex);
+    if (challenge_size > queue->max_challenge) {
+        queue->stats.rejected++;
+        equix_mutex_unlock(&queue->mutex);
+        return 0;
+    }
+    if (queue->count == queue->capacity) {
+        uint32_t lowest = queue->heaps[HEAP_MIN][0];
+        if (queue->entries[lowest].effort >= effort) {
+            queue->stats.rejected++;
+            equix_mutex_unlock(&queue->mutex);
+            return 0;
+        }
+        if (evicted_tag != NULL) {
+            *evicted_tag = queue->entries[lowest].tag;
+        }
+        queue_remove(queue, lowest);
+        queue->stats.evicted++;
+        admitted = 2;
+    }
+    uint32_t idx = queue->free_list[queue->capacity - queue->count - 1];
+    queue_entry* entry = &queue->entries[idx];
+    entry->effort = effort;
+    entry->challenge_size = (uint32_t)challenge_size;
+    entry->seq = queue->next_seq++;
+    entry->tag = tag;
+    entry->solution = *solution;
+    memcpy(&queue->challenges[idx * queue->max_challenge], challenge, challenge_size);
+    size_t pos = queue->count++;
+    heap_set(queue, HEAP_MAX, pos, idx);
+    heap_sift_up(queue, HEAP_MAX, pos);
+    heap_set(queue, HEAP_MIN, pos, idx);
+    heap_sift_up(queue, HEAP_MIN, pos);
+    queue->stats.admitted++;
+    equix_mutex_unlock(&queue->mutex);
+    return admitted;
+}
+
+int equix_queue_verify(
+    equix_queue* queue,
+    equix_ctx* ctx,
+    equix_result* result,
+    uint64_t* tag)
+{
+    uint8_t challenge[EQUIX_QUEUE_MAX_CHALLENGE];
+    equix_solution solution;
+    size_t challenge_size;
+    equix_mutex_lock(&queue->mutex);
+    if (queue->count == 0) {
+        equix_mutex_unlock(&queue->mutex);
+        return 0;
+    }
+    uint32_t idx = queue->heaps[HEAP_MAX][0];
+    queue_entry* entry = &queue->entries[idx];
+    challenge_size = entry->challenge_size;
+    memcpy(challenge, &queue->challenges[idx * queue->max_challenge], challenge_size);
+    solution = entry->solution;
+    *tag = entry->tag;
+    queue_remove(queue, idx);
+    queue->stats.verified++;
+    equix_mutex_unlock(&queue->mutex);
+    *result = equix_verify(ctx, challenge, challenge_size, &solution);
+    return 1;
+}
+
+void equix_queue_get_stats(equix_queue* queue, equix_queue_stats* stats) {
+    equix_mutex_lock(&queue->mutex);
+    *stats = queue->stats;
+    equix_mutex_unlock(&queue->mutex);
+}
@@ -0,0 +1,117 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include <stdlib.h>
+
+#include <equix.h>
+#include <hashx_endian.h>
+#include "atomics.h"
+#include "context.h"
+#include "hooks.h"
+#include "mutex.h"
+#include "solver.h"
+#include "trace.h"
+
+struct equix_race {
+    equix_mutex mutex;
+    equix_prefix prefix;
+    uint64_t start;
+    unsigned workers;
+    equix_accept_func* accept;
+    void* arg;
+    equix_atomic_int done; /* polled by the solver of every worker */
+    int found;
+    uint64_t nonce;
+    equix_solution solution;
+};
+
+equix_race* equix_race_alloc(
+    const equix_prefix* prefix,
+    uint64_t start,
+    unsigned workers,
+    equix_accept_func* accept,
+    void* arg)
+{
+    if (workers == 0 || prefix->size + sizeof(uint64_t) > EQUIX_MAX_PREFIXED_CHALLENGE) {
+        return NULL;
+    }
+    equix_race* race = malloc(sizeof(equix_race));
+    if (race == NULL) {
+        return NULL;
+    }
+    equix_mutex_init(&race->mutex);
+    race->prefix = *prefix;
+    race->start = start;
+    race->workers = workers;
+    race->accept = accept;
+    race->arg = arg;
+    equix_atomic_init(&race->done, 0);
+    race->found = 0;
+    return race;
+}
+
+void equix_race_free(equix_race* race) {
+    if (race != NULL) {
+        equix_mutex_destroy(&race->mutex);
+        free(race);
+    }
+}
+
+/* the first caller wins */
+static int race_finish(equix_race* race, uint64_t nonce, const equix_solution* solution) {
+    int won = 0;
+    equix_mutex_lock(&race->mutex);
+    if (!equix_atomic_load(&race->done)) {
+        race->found = 1;
+        race->nonce = nonce;
+        race->solution = *solution;
+        equix_atomic_store(&race->done, 1);
+        won = 1;
+    }
+    equix_mutex_unlock(&race->mutex);
+    return won;
+}
+
+int equix_race_run(equix_race* race, equix_ctx* ctx, unsigned worker) {
+    if ((ctx->flags & EQUIX_CTX_SOLVE) == 0 || worker >= race->workers) {
+        return 0;
+    }
+    uint8_t challenge[EQUIX_MAX_PREFIXED_CHALLENGE];
+    uint8_t suffix[sizeof(uint64_t)];
+    equix_solution output[EQUIX_MAX_SOLS];
+    uint64_t nonce = race->start + worker;
+    for (; !equix_atomic_load(&race->done); nonce += race->workers) {
+        store64(suffix, nonce);
+        size_t size = equix_prefix_challenge(&race->prefix, suffix, sizeof(suffix), challenge);
+        /* every nonce gives a new challenge, so skip the cache of make_hash_func */
+        equix_invalidate_hash(ctx);
+        if (!traced_make(ctx, ctx->hash_func, challenge, size)) {
+            continue;
+        }
+        int count = solver_run(ctx, ctx->hash_func, output, &race->done);
+        for (int i = 0; i < count; ++i) {
+            if (race->accept == NULL ||
+                race->accept(challenge, size, &output[i], race->arg)) {
+                return race_finish(race, nonce, &output[i]);
+            }
+        }
+    }
+    return 0;
+}
+
+void equix_race_cancel(equix_race* race) {
+    equix_mutex_lock(&race->mutex);
+    equix_atomic_store(&race->done, 1);
+    equix_mutex_unlock(&race->mutex);
+}
+
+int equix_race_result(equix_race* race, uint64_t* nonce, equix_solution* solution) {
+    equix_mutex_lock(&race->mutex);
+    int found = race->found;
+    if (found) {
+        *nonce = race->nonce;
+        *solution = race->solution;
+    }
+    equix_mutex_unlock(&race->mutex);
+    return found;
+}
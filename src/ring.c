@@ -0,0 +1,474 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <linux/futex.h>
+
+#include <equix.h>
+#include <equix_ring.h>
+
+#define RING_MAGIC 0x58495551 /* "QUIX" */
+#define RING_VERSION 3
+#define RING_SPIN_COUNT 2000
+#define RING_PATH_MAX 256
+#define RING_WAIT_NS 100000000 /* recheck for shutdown every 100 ms */
+#define RING_ABANDON_TIMEOUT 1.0 /* seconds */
+#define RING_ABANDON_MS 1000
+#define STALL_MS_MASK 0x3fffffff
+
+/*
+ * Every slot goes through the following sequence numbers, where t is the
+ * ticket that owns the slot:
+ *
+ *   t      free, the client with ticket t may claim it
+ *   t+1    claimed, the client is writing the record
+ *   t+2    record is ready for verification
+ *   t+3    a verifier has claimed the record
+ *   t+4    result is ready, or the ticket was abandoned
+ *   t+N    released by the client, free for ticket t+N
+ *
+ * All transitions are compare-and-swap operations, so a process that
+ * stops in the middle of the protocol can be overtaken. Verifiers take
+ * any ready record between the tail and the head, so a ticket that is
+ * not submitted yet only holds up the tail, which verifiers abandon after
+ * RING_ABANDON_TIMEOUT. The client of ticket t+N takes over a result that
+ * was not released within RING_ABANDON_TIMEOUT, and verifiers take over
+ * the slot after twice that if the client of t+N has stopped as well.
+ * The late process then finds the slot moved and backs off. Slot states
+ * of consecutive laps must not overlap, so a ring has at least 8 slots.
+ */
+typedef struct ring_slot {
+    _Atomic uint32_t seq;
+    _Atomic uint32_t waiters;
+    uint32_t challenge_size;
+    _Atomic uint32_t result;
+    equix_solution solution;
+    uint8_t challenge[EQUIX_RING_MAX_CHALLENGE];
+    uint8_t padding[32];
+} ring_slot; /* 128 bytes */
+
+typedef struct ring_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t max_challenge;
+    _Alignas(64) _Atomic uint32_t head;      /* next client ticket */
+    _Alignas(64) _Atomic uint32_t tail;      /* next verifier ticket */
+    _Alignas(64) _Atomic uint32_t submitted; /* futex for idle verifiers */
+    _Atomic uint32_t idle;
+    _Atomic uint32_t shutdown;
+    _Alignas(64) ring_slot slots[];
+} ring_header;
+
+struct equix_ring {
+    ring_header* header;
+    size_t size;
+    uint32_t mask;
+    _Atomic uint64_t stall; /* tail ticket << 32 | state << 30 | ms */
+};
+
+static void futex_wait(_Atomic uint32_t* addr, uint32_t value, bool timeout) {
+    struct timespec ts = { 0, RING_WAIT_NS };
+    syscall(SYS_futex, addr, FUTEX_WAIT, value, timeout ? &ts : NULL, NULL, 0);
+}
+
+static void futex_wake(_Atomic uint32_t* addr, int count) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+static double ring_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* time in ms for stall records, never 0 */
+static uint32_t ring_ms(void) {
+    uint32_t ms = (uint32_t)(uint64_t)(ring_time() * 1e3) & STALL_MS_MASK;
+    return ms != 0 ? ms : 1;
+}
+
+static bool ring_path(const char* name, char path[RING_PATH_MAX]) {
+    if (name == NULL || strchr(name, '/') != NULL) {
+        return false;
+    }
+    int len = snprintf(path, RING_PATH_MAX, "/dev/shm/%s", name);
+    return len > 0 && len < RING_PATH_MAX;
+}
+
+static equix_ring* ring_map(int fd, size_t size) {
+    equix_ring* ring = malloc(sizeof(equix_ring));
+    if (ring == NULL) {
+        return NULL;
+    }
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) {
+        free(ring);
+        return NULL;
+    }
+    ring->header = mem;
+    ring->size = size;
+    atomic_init(&ring->stall, 0);
+    return ring;
+}
+
+typedef enum slot_status {
+    SLOT_READY,
+    SLOT_TIMEOUT,
+    SLOT_SHUTDOWN,
+} slot_status;
+
+/* sequence numbers are compared modulo 2^32 */
+static inline bool seq_reached(uint32_t seq, uint32_t expected) {
+    return (int32_t)(seq - expected) >= 0;
+}
+
+/*
+ * Wait until the sequence number of a slot reaches or passes the expected
+ * value, for at most `timeout` seconds. The caller checks which it was.
+ */
+static slot_status slot_wait(ring_header* header, ring_slot* slot, uint32_t expected, double timeout) {
+    for (int i = 0; i < RING_SPIN_COUNT; ++i) {
+        if (seq_reached(atomic_load_explicit(&slot->seq, memory_order_acquire), expected)) {
+            return SLOT_READY;
+        }
+        cpu_relax();
+    }
+    double deadline = ring_time() + timeout;
+    slot_status status;
+    for (;;) {
+        atomic_fetch_add(&slot->waiters, 1);
+        uint32_t seq = atomic_load(&slot->seq);
+        if (seq_reached(seq, expected)) {
+            status = SLOT_READY;
+            break;
+        }
+        if (atomic_load(&header->shutdown)) {
+            status = SLOT_SHUTDOWN;
+            break;
+        }
+        if (ring_time() >= deadline) {
+            status = SLOT_TIMEOUT;
+            break;
+        }
+        futex_wait(&slot->seq, seq, true);
+        atomic_fetch_sub(&slot->waiters, 1);
+    }
+    atomic_fetch_sub(&slot->waiters, 1);
+    return status;
+}
+
+/* fails if another process has moved the slot first */
+static bool slot_advance(ring_slot* slot, uint32_t from, uint32_t to) {
+    if (!atomic_compare_exchange_strong(&slot->seq, &from, to)) {
+        return false;
+    }
+    if (atomic_load(&slot->waiters) != 0) {
+        futex_wake(&slot->seq, INT_MAX);
+    }
+    return true;
+}
+
+equix_ring* equix_ring_create(const char* name, unsigned slots_log2) {
+    char path[RING_PATH_MAX];
+    if (slots_log2 < 3 || slots_log2 > 16 || !ring_path(name, path)) {
+        return NULL;
+    }
+    uint32_t num_slots = UINT32_C(1) << slots_log2;
+    size_t size = sizeof(ring_header) + num_slots * sizeof(ring_slot);
+    unlink(path);
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+    equix_ring* ring = ring_map(fd, size);
+    close(fd);
+    if (ring == NULL) {
+        unlink(path);
+        return NULL;
+    }
+    ring_header* header = ring->header;
+    header->num_slots = num_slots;
+    header->max_challenge = EQUIX_RING_MAX_CHALLENGE;
+    header->version = RING_VERSION;
+    atomic_init(&header->head, 0);
+    atomic_init(&header->tail, 0);
+    atomic_init(&header->submitted, 0);
+    atomic_init(&header->idle, 0);
+    atomic_init(&header->shutdown, 0);
+    for (uint32_t i = 0; i < num_slots; ++i) {
+        atomic_init(&header->slots[i].seq, i);
+        atomic_init(&header->slots[i].waiters, 0);
+    }
+    ring->mask = num_slots - 1;
+    atomic_thread_fence(memory_order_release);
+    header->magic = RING_MAGIC;
+    return ring;
+}
+
+equix_ring* equix_ring_open(const char* name) {
+    char path[RING_PATH_MAX];
+    if (!ring_path(name, path)) {
+        return NULL;
+    }
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ring_header)) {
+        close(fd);
+        return NULL;
+    }
+    equix_ring* ring = ring_map(fd, st.st_size);
+    close(fd);
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring_header* header = ring->header;
+    if (header->magic != RING_MAGIC || header->version != RING_VERSION ||
+        header->max_challenge != EQUIX_RING_MAX_CHALLENGE ||
+        header->num_slots < 8 ||
+        (header->num_slots & (header->num_slots - 1)) != 0 ||
+        ring->size < sizeof(ring_header) + header->num_slots * sizeof(ring_slot)) {
+        equix_ring_close(ring);
+        return NULL;
+    }
+    ring->mask = header->num_slots - 1;
+    return ring;
+}
+
+void equix_ring_close(equix_ring* ring) {
+    if (ring != NULL) {
+        munmap(ring->header, ring->size);
+        free(ring);
+    }
+}
+
+int equix_ring_submit(
+    equix_ring* ring,
+    const void* challenge,
+    size_t challenge_size,
+    const equix_solution* solution,
+    equix_ring_ticket* ticket)
+{
+    ring_header* header = ring->header;
+    if (challenge_size > EQUIX_RING_MAX_CHALLENGE ||
+        atomic_load(&header->shutdown)) {
+        return 0;
+    }
+    uint32_t num_slots = ring->mask + 1;
+    uint32_t t = atomic_fetch_add(&header->head, 1);
+    ring_slot* slot = &header->slots[t & ring->mask];
+    for (;;) {
+        slot_status status = slot_wait(header, slot, t, RING_ABANDON_TIMEOUT);
+        if (status == SLOT_READY) {
+            break;
+        }
+        if (status == SLOT_SHUTDOWN) {
+            return 0;
+        }
+        /* take over a result that its client did not release */
+        slot_advance(slot, t - num_slots + 4, t);
+    }
+    if (!slot_advance(slot, t, t + 1)) {
+        /* the verifiers have abandoned this ticket */
+        slot_advance(slot, t + 4, t + num_slots);
+        return 0;
+    }
+    memcpy(slot->challenge, challenge, challenge_size);
+    slot->challenge_size = (uint32_t)challenge_size;
+    slot->solution = *solution;
+    if (!slot_advance(slot, t + 1, t + 2)) {
+        slot_advance(slot, t + 4, t + num_slots);
+        return 0;
+    }
+    atomic_fetch_add(&header->submitted, 1);
+    if (atomic_load(&header->idle) != 0) {
+        futex_wake(&header->submitted, 1);
+    }
+    *ticket = t;
+    return 1;
+}
+
+equix_result equix_ring_wait(equix_ring* ring, equix_ring_ticket ticket) {
+    ring_header* header = ring->header;
+    uint32_t num_slots = ring->mask + 1;
+    ring_slot* slot = &header->slots[ticket & ring->mask];
+    for (;;) {
+        slot_status status = slot_wait(header, slot, ticket + 4, RING_ABANDON_TIMEOUT);
+        if (status == SLOT_READY) {
+            break;
+        }
+        if (status == SLOT_SHUTDOWN) {
+            return EQUIX_CHALLENGE;
+        }
+        if (atomic_load(&slot->seq) - ticket >= num_slots) {
+            /* the slot was taken over by the next lap */
+            return EQUIX_TIMEOUT;
+        }
+    }
+    equix_result result = (equix_result)atomic_load_explicit(&slot->result, memory_order_relaxed);
+    if (!slot_advance(slot, ticket + 4, ticket + num_slots)) {
+        return EQUIX_TIMEOUT;
+    }
+    return result;
+}
+
+equix_result equix_ring_verify(
+    equix_ring* ring,
+    const void* challenge,
+    size_t challenge_size,
+    const equix_solution* solution)
+{
+    equix_ring_ticket ticket;
+    if (!equix_ring_submit(ring, challenge, challenge_size, solution, &ticket)) {
+        return EQUIX_CHALLENGE;
+    }
+    return equix_ring_wait(ring, ticket);
+}
+
+/*
+ * Verify the record of a claimed slot. The record is copied first, so a
+ * client that writes into the slot late cannot change it mid-verification.
+ */
+static void verify_slot(equix_ctx* ctx, ring_slot* slot, uint32_t t) {
+    uint8_t challenge[EQUIX_RING_MAX_CHALLENGE];
+    uint32_t size = slot->challenge_size;
+    equix_solution solution = slot->solution;
+    equix_result result = EQUIX_CHALLENGE;
+    if (size <= EQUIX_RING_MAX_CHALLENGE) {
+        memcpy(challenge, slot->challenge, size);
+        result = equix_verify(ctx, challenge, size, &solution);
+    }
+    atomic_store_explicit(&slot->result, result, memory_order_relaxed);
+    slot_advance(slot, t + 3, t + 4);
+}
+
+/*
+ * Returns true once the tail ticket has been stalled in the same state
+ * for `limit_ms`. The stall is timed from the first call that sees it.
+ */
+static bool stall_expired(equix_ring* ring, uint32_t t, uint32_t state, uint32_t limit_ms) {
+    uint32_t now = ring_ms();
+    uint64_t key = (uint64_t)t << 32 | (uint64_t)state << 30;
+    uint64_t stall = atomic_load(&ring->stall);
+    if ((stall & ~(uint64_t)STALL_MS_MASK) != key || (stall & STALL_MS_MASK) == 0) {
+        atomic_compare_exchange_strong(&ring->stall, &stall, key | now);
+        return false;
+    }
+    return ((now - (uint32_t)stall) & STALL_MS_MASK) >= limit_ms;
+}
+
+/*
+ * Move the tail past tickets that are verified or being verified, and
+ * abandon a stalled tail ticket. Returns true if the tail is stalled.
+ */
+static bool advance_tail(equix_ring* ring) {
+    ring_header* header = ring->header;
+    uint32_t num_slots = ring->mask + 1;
+    for (;;) {
+        uint32_t t = atomic_load(&header->tail);
+        if (t == atomic_load(&header->head)) {
+            return false;
+        }
+        ring_slot* slot = &header->slots[t & ring->mask];
+        uint32_t seq = atomic_load(&slot->seq);
+        if (seq_reached(seq, t + 3)) {
+            atomic_compare_exchange_strong(&header->tail, &t, t + 1);
+            continue;
+        }
+        uint32_t state, limit_ms;
+        if (seq == t || seq == t + 1) {
+            /* the ticket was taken, but its record is not submitted */
+            state = seq - t;
+            limit_ms = RING_ABANDON_MS;
+        }
+        else if (seq == t - num_slots + 4) {
+            /* neither the last client nor the next one freed the slot */
+            state = 2;
+            limit_ms = 2 * RING_ABANDON_MS;
+        }
+        else {
+            return false;
+        }
+        if (!stall_expired(ring, t, state, limit_ms)) {
+            return true;
+        }
+        if (slot_advance(slot, seq, t + 4)) {
+            atomic_compare_exchange_strong(&header->tail, &t, t + 1);
+        }
+    }
+}
+
+unsigned equix_ring_serve(equix_ring* ring, equix_ctx* ctx, unsigned max_batch) {
+    ring_header* header = ring->header;
+    uint32_t num_slots = ring->mask + 1;
+    unsigned count = 0;
+    while (count < max_batch) {
+        uint32_t submitted = atomic_load(&header->submitted);
+        uint32_t t = atomic_load(&header->tail);
+        uint32_t head = atomic_load(&header->head);
+        uint32_t end = head - t > num_slots ? t + num_slots : head;
+        unsigned found = 0;
+        for (; t != end && count < max_batch; ++t) {
+            ring_slot* slot = &header->slots[t & ring->mask];
+            uint32_t expected = t + 2;
+            if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == expected &&
+                atomic_compare_exchange_strong(&slot->seq, &expected, t + 3)) {
+                verify_slot(ctx, slot, t);
+                count++;
+                found++;
+            }
+        }
+        bool stalled = advance_tail(ring);
+        if (found > 0) {
+            continue;
+        }
+        if (count > 0) {
+            break;
+        }
+        if (atomic_load(&header->shutdown)) {
+            return 0;
+        }
+        /* nothing is ready, sleep until a record is submitted */
+        atomic_fetch_add(&header->idle, 1);
+        futex_wait(&header->submitted, submitted, stalled);
+        atomic_fetch_sub(&header->idle, 1);
+    }
+    return count;
+}
+
+void equix_ring_shutdown(equix_ring* ring) {
+    ring_header* header = ring->header;
+    atomic_store(&header->shutdown, 1);
+    atomic_fetch_add(&header->submitted, 1);
+    futex_wake(&header->submitted, INT_MAX);
+    for (uint32_t i = 0; i < header->num_slots; ++i) {
+        futex_wake(&header->slots[i].seq, INT_MAX);
+    }
+}
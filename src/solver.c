@@ -4,6 +4,7 @@
 #include "solver.h"
 #include "context.h"
 #include "solver_heap.h"
+#include "trace.h"
 #include <hashx_endian.h>
 #include <string.h>
 #include <stdbool.h>
@@ -39,6 +40,8 @@
         b = temp;           \
     } while(0)
 #define CARRY (bucket_idx != 0)
+#define CANCELLED (cancel != NULL && equix_atomic_load(cancel))
+#define STAGE0_CHUNK 4096
 #define BUCK_START 0
 #define BUCK_END (NUM_COARSE_BUCKETS / 2 + 1)
 
@@ -53,13 +56,13 @@ static FORCE_INLINE uint64_t hash_value(hashx_ctx* hash_func, equix_idx index) {
     return load64(hash);
 }
 
-static void build_solution_stage1(equix_idx* output, solver_heap* heap, s2_idx root) {
+static void build_solution_stage1(equix_idx* output, const stage1_idx_hashtab* stage1, s2_idx root) {
     u32 bucket = ITEM_BUCKET(root);
     u32 bucket_inv = INVERT_BUCKET(bucket);
     u32 left_parent_idx = ITEM_LEFT_IDX(root);
     u32 right_parent_idx = ITEM_RIGHT_IDX(root);
-    s1_idx left_parent = STAGE1_IDX(bucket, left_parent_idx);
-    s1_idx right_parent = STAGE1_IDX(bucket_inv, right_parent_idx);
+    s1_idx left_parent = stage1->buckets[bucket].items[left_parent_idx];
+    s1_idx right_parent = stage1->buckets[bucket_inv].items[right_parent_idx];
     output[0] = left_parent;
     output[1] = right_parent;
     if (!tree_cmp1(&output[0], &output[1])) {
@@ -67,44 +70,57 @@ static void build_solution_stage1(equix_idx* output, solver_heap* heap, s2_idx r
     }
 }
 
-static void build_solution_stage2(equix_idx* output, solver_heap* heap, s3_idx root) {
+static void build_solution_stage2(equix_idx* output, const stage1_idx_hashtab* stage1, const stage2_idx_hashtab* stage2, s3_idx root) {
     u32 bucket = ITEM_BUCKET(root);
     u32 bucket_inv = INVERT_BUCKET(bucket);
     u32 left_parent_idx = ITEM_LEFT_IDX(root);
     u32 right_parent_idx = ITEM_RIGHT_IDX(root);
-    s2_idx left_parent = STAGE2_IDX(bucket, left_parent_idx);
-    s2_idx right_parent = STAGE2_IDX(bucket_inv, right_parent_idx);
-    build_solution_stage1(&output[0], heap, left_parent);
-    build_solution_stage1(&output[2], heap, right_parent);
+    s2_idx left_parent = stage2->buckets[bucket].items[left_parent_idx];
+    s2_idx right_parent = stage2->buckets[bucket_inv].items[right_parent_idx];
+    build_solution_stage1(&output[0], stage1, left_parent);
+    build_solution_stage1(&output[2], stage1, right_parent);
     if (!tree_cmp2(&output[0], &output[2])) {
         SWAP_IDX(output[0], output[2]);
         SWAP_IDX(output[1], output[3]);
     }
 }
 
-static void build_solution(equix_solution* solution, solver_heap* heap, s3_idx left, s3_idx right) {
-    build_solution_stage2(&solution->idx[0], heap, left);
-    build_solution_stage2(&solution->idx[4], heap, right);
+void equix_solver_build(
+    equix_solution* solution,
+    const stage1_idx_hashtab* stage1,
+    const stage2_idx_hashtab* stage2,
+    stage3_idx_item left,
+    stage3_idx_item right)
+{
+    EQUIX_PROBE1(build_start, stage1);
+    build_solution_stage2(&solution->idx[0], stage1, stage2, left);
+    build_solution_stage2(&solution->idx[4], stage1, stage2, right);
     if (!tree_cmp4(&solution->idx[0], &solution->idx[4])) {
         SWAP_IDX(solution->idx[0], solution->idx[4]);
         SWAP_IDX(solution->idx[1], solution->idx[5]);
         SWAP_IDX(solution->idx[2], solution->idx[6]);
         SWAP_IDX(solution->idx[3], solution->idx[7]);
     }
+    EQUIX_PROBE1(build_done, stage1);
 }
 
-static void solve_stage0(hashx_ctx* hash_func, solver_heap* heap) {
+static bool solve_stage0(hashx_ctx* hash_func, solver_heap* heap, const equix_atomic_int* cancel) {
     CLEAR(heap->stage1_indices.counts);
-    for (u32 i = 0; i < INDEX_SPACE; ++i) {
-        uint64_t value = hash_value(hash_func, i);
-        u32 bucket_idx = value % NUM_COARSE_BUCKETS;
-        u32 item_idx = STAGE1_SIZE(bucket_idx);
-        if (item_idx >= COARSE_BUCKET_ITEMS)
-            continue;
-        STAGE1_SIZE(bucket_idx) = item_idx + 1;
-        STAGE1_IDX(bucket_idx, item_idx) = i;
-        STAGE1_DATA(bucket_idx, item_idx) = value / NUM_COARSE_BUCKETS; /* 52 bits */
+    for (u32 chunk = 0; chunk < INDEX_SPACE; chunk += STAGE0_CHUNK) {
+        if (CANCELLED)
+            return false;
+        for (u32 i = chunk; i < chunk + STAGE0_CHUNK; ++i) {
+            uint64_t value = hash_value(hash_func, i);
+            u32 bucket_idx = value % NUM_COARSE_BUCKETS;
+            u32 item_idx = STAGE1_SIZE(bucket_idx);
+            if (item_idx >= COARSE_BUCKET_ITEMS)
+                continue;
+            STAGE1_SIZE(bucket_idx) = item_idx + 1;
+            STAGE1_IDX(bucket_idx, item_idx) = i;
+            STAGE1_DATA(bucket_idx, item_idx) = value / NUM_COARSE_BUCKETS; /* 52 bits */
+        }
     }
+    return true;
 }
 
 #define MAKE_PAIRS1                                                           \
@@ -129,9 +145,11 @@ static void solve_stage0(hashx_ctx* hash_func, solver_heap* heap) {
             sum / NUM_COARSE_BUCKETS; /* 37 bits */                           \
     }                                                                         \
 
-static void solve_stage1(solver_heap* heap) {
+static bool solve_stage1(solver_heap* heap, const equix_atomic_int* cancel) {
     CLEAR(heap->stage2_indices.counts);
     for (u32 bucket_idx = BUCK_START; bucket_idx < BUCK_END; ++bucket_idx) {
+        if (CANCELLED)
+            return false;
         u32 cpl_bucket = INVERT_BUCKET(bucket_idx);
         CLEAR(heap->scratch_ht.counts);
         u32 cpl_buck_size = STAGE1_SIZE(cpl_bucket);
@@ -154,6 +172,7 @@ static void solve_stage1(solver_heap* heap) {
             }
         }
     }
+    return true;
 }
 
 #define MAKE_PAIRS2                                                           \
@@ -178,9 +197,11 @@ static void solve_stage1(solver_heap* heap) {
             sum / NUM_COARSE_BUCKETS; /* 22 bits */                           \
     }                                                                         \
 
-static void solve_stage2(solver_heap* heap) {
+static bool solve_stage2(solver_heap* heap, const equix_atomic_int* cancel) {
     CLEAR(heap->stage3_indices.counts);
     for (u32 bucket_idx = BUCK_START; bucket_idx < BUCK_END; ++bucket_idx) {
+        if (CANCELLED)
+            return false;
         u32 cpl_bucket = INVERT_BUCKET(bucket_idx);
         CLEAR(heap->scratch_ht.counts);
         u32 cpl_buck_size = STAGE2_SIZE(cpl_bucket);
@@ -203,6 +224,7 @@ static void solve_stage2(solver_heap* heap) {
             }
         }
     }
+    return true;
 }
 
 #define MAKE_PAIRS3                                                           \
@@ -220,17 +242,20 @@ static void solve_stage2(solver_heap* heap) {
             /* we have a solution */                                          \
             s3_idx item_left = STAGE3_IDX(bucket_idx, item_idx);              \
             s3_idx item_right = STAGE3_IDX(cpl_bucket, cpl_index);            \
-            build_solution(&output[sols_found], heap, item_left, item_right); \
+            equix_solver_build(&output[sols_found], &heap->stage1_indices,    \
+                &heap->stage2_indices, item_left, item_right);                \
             if (++(sols_found) >= EQUIX_MAX_SOLS) {                           \
                 return sols_found;                                            \
             }                                                                 \
         }                                                                     \
     }                                                                         \
 
-static int solve_stage3(solver_heap* heap, equix_solution output[EQUIX_MAX_SOLS]) {
+static int solve_stage3(solver_heap* heap, equix_solution output[EQUIX_MAX_SOLS], const equix_atomic_int* cancel) {
     int sols_found = 0;
 
     for (u32 bucket_idx = BUCK_START; bucket_idx < BUCK_END; ++bucket_idx) {
+        if (CANCELLED)
+            return 0;
         u32 cpl_bucket = -bucket_idx & (NUM_COARSE_BUCKETS - 1);
         bool nodup = cpl_bucket == bucket_idx;
         CLEAR(heap->scratch_ht.counts);
@@ -263,8 +288,60 @@ int equix_solver_solve(
     solver_heap* heap,
     equix_solution output[EQUIX_MAX_SOLS])
 {
-    solve_stage0(hash_func, heap);
-    solve_stage1(heap);
-    solve_stage2(heap);
-    return solve_stage3(heap, output);
+    return equix_solver_solve_cancel(hash_func, heap, output, NULL);
+}
+
+/* runs one stage with the trace probes, returns -1 if cancelled */
+static int run_stage(
+    int stage,
+    hashx_ctx* hash_func,
+    solver_heap* heap,
+    equix_solution output[EQUIX_MAX_SOLS],
+    const equix_atomic_int* cancel)
+{
+    int result = 0;
+    EQUIX_PROBE2(stage_start, heap, stage);
+    switch (stage) {
+    case 0:
+        result = solve_stage0(hash_func, heap, cancel) ? 0 : -1;
+        break;
+    case 1:
+        result = solve_stage1(heap, cancel) ? 0 : -1;
+        break;
+    case 2:
+        result = solve_stage2(heap, cancel) ? 0 : -1;
+        break;
+    default:
+        result = solve_stage3(heap, output, cancel);
+        break;
+    }
+    EQUIX_PROBE3(stage_done, heap, stage,
+        EQUIX_PROBE_ENABLED(stage_done) && stage < 3 && result >= 0 ?
+        solver_count_items(stage == 0 ? heap->stage1_indices.counts :
+            stage == 1 ? heap->stage2_indices.counts :
+            heap->stage3_indices.counts) : (u32)result);
+    return result;
+}
+
+int equix_solver_solve_cancel(
+    hashx_ctx* hash_func,
+    solver_heap* heap,
+    equix_solution output[EQUIX_MAX_SOLS],
+    const equix_atomic_int* cancel)
+{
+    for (int stage = 0; stage < 3; ++stage) {
+        if (run_stage(stage, hash_func, heap, output, cancel) < 0) {
+            return 0;
+        }
+    }
+    return run_stage(3, hash_func, heap, output, cancel);
+}
+
+int equix_solver_stage(
+    int stage,
+    hashx_ctx* hash_func,
+    solver_heap* heap,
+    equix_solution output[EQUIX_MAX_SOLS])
+{
+    return run_stage(stage, hash_func, heap, output, NULL);
 }
@@ -7,7 +7,10 @@
 #include <equix.h>
 #include <hashx_endian.h>
 #include <stdbool.h>
+#include "atomics.h"
 #include "context.h"
+#include "solver_heap.h"
+#include "trace.h"
 
 #define EQUIX_STAGE1_MASK ((1ull << 15) - 1)
 #define EQUIX_STAGE2_MASK ((1ull << 30) - 1)
@@ -27,4 +30,50 @@ static inline bool tree_cmp4(const equix_idx* left, const equix_idx* right) {
 
 EQUIX_PRIVATE int equix_solver_solve(hashx_ctx* hash_func, solver_heap* heap, equix_solution output[EQUIX_MAX_SOLS]);
 
+/* Like equix_solver_solve, but returns 0 early once *cancel is nonzero.
+   The flag is checked at stage and bucket boundaries. */
+EQUIX_PRIVATE int equix_solver_solve_cancel(hashx_ctx* hash_func, solver_heap* heap, equix_solution output[EQUIX_MAX_SOLS], const equix_atomic_int* cancel);
+
+/* Runs a single solver stage (0-3). */
+EQUIX_PRIVATE int equix_solver_stage(int stage, hashx_ctx* hash_func, solver_heap* heap, equix_solution output[EQUIX_MAX_SOLS]);
+
+/* Total number of items in a hash table, for trace probes */
+static inline uint32_t solver_count_items(const uint16_t counts[NUM_COARSE_BUCKETS]) {
+    uint32_t items = 0;
+    for (int i = 0; i < NUM_COARSE_BUCKETS; ++i) {
+        items += counts[i];
+    }
+    return items;
+}
+
+/* Builds a solution from two stage 3 items */
+EQUIX_PRIVATE void equix_solver_build(equix_solution* solution, const stage1_idx_hashtab* stage1, const stage2_idx_hashtab* stage2, stage3_idx_item left, stage3_idx_item right);
+
+/* Low-memory solver, finds the same solutions as equix_solver_solve */
+EQUIX_PRIVATE int equix_solver_lowmem_solve(hashx_ctx* hash_func, solver_lowmem_heap* heap, equix_solution output[EQUIX_MAX_SOLS], const equix_atomic_int* cancel);
+
+EQUIX_PRIVATE int equix_solver_lowmem_stage(int stage, hashx_ctx* hash_func, solver_lowmem_heap* heap, equix_solution output[EQUIX_MAX_SOLS]);
+
+/* Runs the solver selected by the context flags */
+static inline int solver_run(equix_ctx* ctx, hashx_ctx* hash_func, equix_solution output[EQUIX_MAX_SOLS], const equix_atomic_int* cancel) {
+    int count;
+    if (ctx->flags & EQUIX_CTX_LOWMEM) {
+        EQUIX_PROBE2(solve_start, ctx, ctx->lowmem_heap);
+        count = equix_solver_lowmem_solve(hash_func, ctx->lowmem_heap, output, cancel);
+    }
+    else {
+        EQUIX_PROBE2(solve_start, ctx, ctx->heap);
+        count = equix_solver_solve_cancel(hash_func, ctx->heap, output, cancel);
+    }
+    EQUIX_PROBE2(solve_done, ctx, count);
+    return count;
+}
+
+static inline int solver_run_stage(equix_ctx* ctx, int stage, hashx_ctx* hash_func, equix_solution output[EQUIX_MAX_SOLS]) {
+    if (ctx->flags & EQUIX_CTX_LOWMEM) {
+        return equix_solver_lowmem_stage(stage, hash_func, ctx->lowmem_heap, output);
+    }
+    return equix_solver_stage(stage, hash_func, ctx->heap, output);
+}
+
 #endif
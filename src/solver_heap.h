@@ -105,4 +105,17 @@ typedef struct solver_heap {
     fine_hashtab scratch_ht;                     /*   3 200 bytes */
 } solver_heap;                          /* TOTAL: 1 897 088 bytes */
 
+/*
+ * Heap of the low-memory solver (EQUIX_CTX_LOWMEM). Only the indices are
+ * stored; hash values and partial sums are recomputed for the two buckets
+ * being paired.
+ */
+typedef struct solver_lowmem_heap {
+    stage1_idx_hashtab stage1_indices;           /* 172 544 bytes */
+    stage2_idx_hashtab stage2_indices;           /* 344 576 bytes */
+    stage3_idx_hashtab stage3_indices;           /* 344 576 bytes */
+    uint64_t values[2][COARSE_BUCKET_ITEMS];     /*   5 376 bytes */
+    fine_hashtab scratch_ht;                     /*   3 200 bytes */
+} solver_lowmem_heap;                   /* TOTAL:   870 272 bytes */
+
 #endif
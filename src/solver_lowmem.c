@@ -0,0 +1,257 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+/*
+ * Low-memory variant of the solver. The stage 1-3 data (hash values and
+ * partial sums) take more than half of the standard solver heap. Here they
+ * are not stored: every pairing step recomputes the values of the two
+ * buckets it pairs from the stored indices. This needs about 7 times more
+ * hash evaluations, but the heap fits into 1 MiB. The bucket contents are
+ * identical to the standard solver, so the solutions are the same.
+ */
+
+#include "solver.h"
+#include "context.h"
+#include "solver_heap.h"
+#include "trace.h"
+#include <hashx_endian.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#define CLEAR(x) memset(&x, 0, sizeof(x))
+#define ITEM_BUCKET(item) (item) % NUM_COARSE_BUCKETS
+#define ITEM_LEFT_IDX(item) (item) >> 17
+#define ITEM_RIGHT_IDX(item) ((item) >> 8) & 511
+#define MAKE_ITEM(bucket, left, right) ((left) << 17 | (right) << 8 | (bucket))
+#define INVERT_BUCKET(idx) -(idx) % NUM_COARSE_BUCKETS
+#define INVERT_SCRATCH(idx) -(idx) % NUM_FINE_BUCKETS
+#define SCRATCH(buck, pos) heap->scratch_ht.buckets[buck].items[pos]
+#define SCRATCH_SIZE(buck) heap->scratch_ht.counts[buck]
+#define CARRY(bucket) ((bucket) != 0)
+#define CANCELLED (cancel != NULL && equix_atomic_load(cancel))
+#define STAGE0_CHUNK 4096
+#define BUCK_START 0
+#define BUCK_END (NUM_COARSE_BUCKETS / 2 + 1)
+
+typedef uint32_t u32;
+
+static FORCE_INLINE uint64_t hash_value(hashx_ctx* hash_func, equix_idx index) {
+    char hash[HASHX_SIZE];
+    hashx_exec(hash_func, index, hash);
+    return load64(hash);
+}
+
+/* same value as STAGE1_DATA in the standard solver */
+static uint64_t stage1_value(hashx_ctx* hash_func, solver_lowmem_heap* heap, u32 bucket, u32 item) {
+    return hash_value(hash_func, heap->stage1_indices.buckets[bucket].items[item]) / NUM_COARSE_BUCKETS;
+}
+
+/* same value as STAGE2_DATA in the standard solver */
+static uint64_t stage2_value(hashx_ctx* hash_func, solver_lowmem_heap* heap, u32 bucket, u32 item) {
+    stage2_idx_item root = heap->stage2_indices.buckets[bucket].items[item];
+    u32 left_bucket = ITEM_BUCKET(root);
+    uint64_t sum = stage1_value(hash_func, heap, left_bucket, ITEM_LEFT_IDX(root)) + CARRY(left_bucket) +
+        stage1_value(hash_func, heap, INVERT_BUCKET(left_bucket), ITEM_RIGHT_IDX(root));
+    return sum / NUM_FINE_BUCKETS / NUM_COARSE_BUCKETS;
+}
+
+/* same value as STAGE3_DATA in the standard solver */
+static uint64_t stage3_value(hashx_ctx* hash_func, solver_lowmem_heap* heap, u32 bucket, u32 item) {
+    stage3_idx_item root = heap->stage3_indices.buckets[bucket].items[item];
+    u32 left_bucket = ITEM_BUCKET(root);
+    uint64_t sum = stage2_value(hash_func, heap, left_bucket, ITEM_LEFT_IDX(root)) + CARRY(left_bucket) +
+        stage2_value(hash_func, heap, INVERT_BUCKET(left_bucket), ITEM_RIGHT_IDX(root));
+    return sum / NUM_FINE_BUCKETS / NUM_COARSE_BUCKETS;
+}
+
+static void load_values(hashx_ctx* hash_func, solver_lowmem_heap* heap, int stage, u32 bucket, uint64_t* values) {
+    switch (stage) {
+    case 1:
+        for (u32 i = 0; i < heap->stage1_indices.counts[bucket]; ++i) {
+            values[i] = stage1_value(hash_func, heap, bucket, i);
+        }
+        break;
+    case 2:
+        for (u32 i = 0; i < heap->stage2_indices.counts[bucket]; ++i) {
+            values[i] = stage2_value(hash_func, heap, bucket, i);
+        }
+        break;
+    default:
+        for (u32 i = 0; i < heap->stage3_indices.counts[bucket]; ++i) {
+            values[i] = stage3_value(hash_func, heap, bucket, i);
+        }
+        break;
+    }
+}
+
+static bool solve_stage0(hashx_ctx* hash_func, solver_lowmem_heap* heap, const equix_atomic_int* cancel) {
+    CLEAR(heap->stage1_indices.counts);
+    for (u32 chunk = 0; chunk < INDEX_SPACE; chunk += STAGE0_CHUNK) {
+        if (CANCELLED)
+            return false;
+        for (u32 i = chunk; i < chunk + STAGE0_CHUNK; ++i) {
+            u32 bucket_idx = hash_value(hash_func, i) % NUM_COARSE_BUCKETS;
+            u32 item_idx = heap->stage1_indices.counts[bucket_idx];
+            if (item_idx >= COARSE_BUCKET_ITEMS)
+                continue;
+            heap->stage1_indices.counts[bucket_idx] = item_idx + 1;
+            heap->stage1_indices.buckets[bucket_idx].items[item_idx] = i;
+        }
+    }
+    return true;
+}
+
+/*
+ * Pairs item_idx of bucket_idx with the matching items of the complement
+ * bucket. Stages 1 and 2 store the pairs in output, stage 3 builds the
+ * solutions. Returns false when the solution output is full.
+ */
+static FORCE_INLINE bool make_pairs(
+    solver_lowmem_heap* heap,
+    int stage,
+    u32 bucket_idx,
+    u32 item_idx,
+    const uint64_t* values,
+    const uint64_t* cpl_values,
+    u32 cpl_bucket,
+    stage2_idx_hashtab* output,
+    equix_solution* solutions,
+    int* sols_found)
+{
+    uint64_t value = values[item_idx] + CARRY(bucket_idx);
+    u32 fine_buck_idx = value % NUM_FINE_BUCKETS;
+    u32 fine_cpl_bucket = INVERT_SCRATCH(fine_buck_idx);
+    u32 fine_cpl_size = SCRATCH_SIZE(fine_cpl_bucket);
+    for (u32 fine_idx = 0; fine_idx < fine_cpl_size; ++fine_idx) {
+        u32 cpl_index = SCRATCH(fine_cpl_bucket, fine_idx);
+        uint64_t sum = value + cpl_values[cpl_index];
+        assert((sum % NUM_FINE_BUCKETS) == 0);
+        sum /= NUM_FINE_BUCKETS;
+        if (stage == 3) {
+            if ((sum & EQUIX_STAGE1_MASK) == 0) {
+                /* we have a solution */
+                equix_solver_build(&solutions[*sols_found], &heap->stage1_indices, &heap->stage2_indices,
+                    heap->stage3_indices.buckets[bucket_idx].items[item_idx],
+                    heap->stage3_indices.buckets[cpl_bucket].items[cpl_index]);
+                if (++(*sols_found) >= EQUIX_MAX_SOLS) {
+                    return false;
+                }
+            }
+            continue;
+        }
+        u32 out_buck_id = sum % NUM_COARSE_BUCKETS;
+        u32 out_item_id = output->counts[out_buck_id];
+        if (out_item_id >= COARSE_BUCKET_ITEMS)
+            continue;
+        output->counts[out_buck_id] = out_item_id + 1;
+        output->buckets[out_buck_id].items[out_item_id] =
+            MAKE_ITEM(bucket_idx, item_idx, cpl_index);
+    }
+    return true;
+}
+
+/* Returns false if cancelled */
+static bool solve_pairs(
+    hashx_ctx* hash_func,
+    solver_lowmem_heap* heap,
+    int stage,
+    equix_solution* solutions,
+    int* sols_found,
+    const equix_atomic_int* cancel)
+{
+    const uint16_t* counts = stage == 1 ? heap->stage1_indices.counts :
+        stage == 2 ? heap->stage2_indices.counts : heap->stage3_indices.counts;
+    stage2_idx_hashtab* output = stage == 1 ? &heap->stage2_indices :
+        stage == 2 ? &heap->stage3_indices : NULL;
+    if (output != NULL) {
+        CLEAR(output->counts);
+    }
+    for (u32 bucket_idx = BUCK_START; bucket_idx < BUCK_END; ++bucket_idx) {
+        if (CANCELLED)
+            return false;
+        u32 cpl_bucket = INVERT_BUCKET(bucket_idx);
+        const uint64_t* values = heap->values[0];
+        const uint64_t* cpl_values = heap->values[0];
+        load_values(hash_func, heap, stage, bucket_idx, heap->values[0]);
+        if (cpl_bucket != bucket_idx) {
+            load_values(hash_func, heap, stage, cpl_bucket, heap->values[1]);
+            cpl_values = heap->values[1];
+        }
+        CLEAR(heap->scratch_ht.counts);
+        u32 cpl_buck_size = counts[cpl_bucket];
+        for (u32 item_idx = 0; item_idx < cpl_buck_size; ++item_idx) {
+            u32 fine_buck_idx = cpl_values[item_idx] % NUM_FINE_BUCKETS;
+            u32 fine_item_idx = SCRATCH_SIZE(fine_buck_idx);
+            if (fine_item_idx >= FINE_BUCKET_ITEMS)
+                continue;
+            SCRATCH_SIZE(fine_buck_idx) = fine_item_idx + 1;
+            SCRATCH(fine_buck_idx, fine_item_idx) = item_idx;
+            if (cpl_bucket == bucket_idx &&
+                !make_pairs(heap, stage, bucket_idx, item_idx, values, cpl_values,
+                    cpl_bucket, output, solutions, sols_found)) {
+                return true;
+            }
+        }
+        if (cpl_bucket != bucket_idx) {
+            u32 buck_size = counts[bucket_idx];
+            for (u32 item_idx = 0; item_idx < buck_size; ++item_idx) {
+                if (!make_pairs(heap, stage, bucket_idx, item_idx, values, cpl_values,
+                    cpl_bucket, output, solutions, sols_found)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/* runs one stage with the trace probes, returns -1 if cancelled */
+static int run_stage(
+    int stage,
+    hashx_ctx* hash_func,
+    solver_lowmem_heap* heap,
+    equix_solution output[EQUIX_MAX_SOLS],
+    const equix_atomic_int* cancel)
+{
+    int sols_found = 0;
+    bool done;
+    EQUIX_PROBE2(stage_start, heap, stage);
+    if (stage == 0) {
+        done = solve_stage0(hash_func, heap, cancel);
+    }
+    else {
+        done = solve_pairs(hash_func, heap, stage < 3 ? stage : 3, output, &sols_found, cancel);
+    }
+    EQUIX_PROBE3(stage_done, heap, stage,
+        EQUIX_PROBE_ENABLED(stage_done) && stage < 3 && done ?
+        solver_count_items(stage == 0 ? heap->stage1_indices.counts :
+            stage == 1 ? heap->stage2_indices.counts :
+            heap->stage3_indices.counts) : (u32)sols_found);
+    return done ? sols_found : -1;
+}
+
+int equix_solver_lowmem_solve(
+    hashx_ctx* hash_func,
+    solver_lowmem_heap* heap,
+    equix_solution output[EQUIX_MAX_SOLS],
+    const equix_atomic_int* cancel)
+{
+    for (int stage = 0; stage < 3; ++stage) {
+        if (run_stage(stage, hash_func, heap, output, cancel) < 0) {
+            return 0;
+        }
+    }
+    int sols_found = run_stage(3, hash_func, heap, output, cancel);
+    return sols_found > 0 ? sols_found : 0;
+}
+
+int equix_solver_lowmem_stage(
+    int stage,
+    hashx_ctx* hash_func,
+    solver_lowmem_heap* heap,
+    equix_solution output[EQUIX_MAX_SOLS])
+{
+    int sols_found = run_stage(stage, hash_func, heap, output, NULL);
+    return sols_found > 0 ? sols_found : 0;
+}
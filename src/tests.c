@@ -9,6 +9,7 @@
 #include <equix.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 typedef bool test_func();
 
@@ -81,6 +82,16 @@ static bool test_verify4() {
     return true;
 }
 
+static bool test_verify_repeat() {
+    equix_solution sols[EQUIX_MAX_SOLS];
+    int other = nonce + 1;
+    assert(equix_solve(ctx, &nonce, sizeof(nonce), sols) > 0);
+    assert(equix_verify(ctx, &nonce, sizeof(nonce), &sols[0]) == EQUIX_OK);
+    assert(equix_verify(ctx, &other, sizeof(other), &sols[0]) != EQUIX_OK);
+    assert(equix_verify(ctx, &nonce, sizeof(nonce), &sols[0]) == EQUIX_OK);
+    return true;
+}
+
 static void permute_idx(int start) {
     if (start == EQUIX_NUM_IDX - 1) {
         equix_result result = equix_verify(ctx, &nonce, sizeof(nonce), &solution[0]);
@@ -102,6 +113,209 @@ static bool test_permutations() {
     return true;
 }
 
+static bool test_solve_prepared() {
+    equix_solution expected[3][EQUIX_MAX_SOLS];
+    int expected_count[3];
+    equix_solution output[EQUIX_MAX_SOLS];
+    for (int seed = 0; seed < 3; ++seed) {
+        expected_count[seed] = equix_solve(ctx, &seed, sizeof(seed), expected[seed]);
+    }
+    int seed = 0;
+    equix_prepare(ctx, &seed, sizeof(seed));
+    for (; seed < 3; ++seed) {
+        int next = seed + 1;
+        if (next < 3) {
+            equix_prepare(ctx, &next, sizeof(next));
+        }
+        int count = equix_solve_prepared(ctx, output);
+        assert(count == expected_count[seed]);
+        assert(memcmp(output, expected[seed], count * sizeof(equix_solution)) == 0);
+    }
+    return true;
+}
+
+static bool test_solve_split() {
+    equix_solution expected[EQUIX_MAX_SOLS];
+    equix_solution output[EQUIX_MAX_SOLS];
+    int expected_count = equix_solve(ctx, &nonce, sizeof(nonce), expected);
+    assert(equix_solve_hashes(ctx, &nonce, sizeof(nonce)));
+    int count = equix_solve_pairs(ctx, output);
+    assert(count == expected_count);
+    assert(memcmp(output, expected, count * sizeof(equix_solution)) == 0);
+    assert(equix_solve_pairs(ctx, output) == 0);
+    return true;
+}
+
+static bool test_lowmem() {
+    equix_ctx* lowmem_ctx = equix_alloc(EQUIX_CTX_SOLVE | EQUIX_CTX_LOWMEM);
+    assert(lowmem_ctx != NULL && lowmem_ctx != EQUIX_NOTSUPP);
+    for (int seed = 0; seed < 3; ++seed) {
+        equix_solution expected[EQUIX_MAX_SOLS];
+        equix_solution output[EQUIX_MAX_SOLS];
+        int expected_count = equix_solve(ctx, &seed, sizeof(seed), expected);
+        int count = equix_solve(lowmem_ctx, &seed, sizeof(seed), output);
+        assert(count == expected_count);
+        assert(memcmp(output, expected, count * sizeof(equix_solution)) == 0);
+    }
+    equix_free(lowmem_ctx);
+    return true;
+}
+
+static bool test_queue() {
+    equix_solution sols[EQUIX_MAX_SOLS];
+    equix_queue_stats stats;
+    equix_result result;
+    uint64_t tag;
+    assert(equix_solve(ctx, &nonce, sizeof(nonce), sols) > 0);
+    equix_queue* queue = equix_queue_alloc(2, sizeof(nonce));
+    assert(queue != NULL);
+    uint64_t evicted = 0;
+    assert(equix_queue_push(queue, &nonce, sizeof(nonce), &sols[0], 1, 1, &evicted) == 1);
+    assert(equix_queue_push(queue, &nonce, sizeof(nonce), &sols[0], 5, 2, &evicted) == 1);
+    assert(equix_queue_push(queue, &nonce, sizeof(nonce), &sols[0], 3, 3, &evicted) == 2);
+    assert(evicted == 1);
+    assert(!equix_queue_push(queue, &nonce, sizeof(nonce), &sols[0], 3, 4, NULL)); /* rejected */
+    assert(!equix_queue_push(queue, &nonce, sizeof(nonce) + 1, &sols[0], 9, 5, NULL)); /* too large */
+    assert(equix_queue_verify(queue, ctx, &result, &tag));
+    assert(tag == 2 && result == EQUIX_OK);
+    assert(equix_queue_verify(queue, ctx, &result, &tag));
+    assert(tag == 3 && result == EQUIX_OK);
+    assert(!equix_queue_verify(queue, ctx, &result, &tag));
+    equix_queue_get_stats(queue, &stats);
+    assert(stats.admitted == 3 && stats.rejected == 2);
+    assert(stats.evicted == 1 && stats.verified == 2);
+    equix_queue_free(queue);
+    return true;
+}
+
+static bool test_try_compile() {
+    equix_ctx* try_ctx = equix_alloc(EQUIX_CTX_VERIFY | EQUIX_CTX_TRY_COMPILE);
+    assert(try_ctx != NULL && try_ctx != EQUIX_NOTSUPP);
+    equix_solution sols[EQUIX_MAX_SOLS];
+    assert(equix_solve(ctx, &nonce, sizeof(nonce), sols) > 0);
+    assert(equix_verify(try_ctx, &nonce, sizeof(nonce), &sols[0]) == EQUIX_OK);
+    equix_free(try_ctx);
+    return true;
+}
+
+static bool test_auto_compile() {
+    equix_ctx* auto_ctx = equix_alloc(EQUIX_CTX_VERIFY | EQUIX_CTX_AUTO_COMPILE);
+    assert(auto_ctx != NULL && auto_ctx != EQUIX_NOTSUPP);
+    equix_solution sols[EQUIX_MAX_SOLS];
+    equix_result results[EQUIX_MAX_SOLS];
+    equix_verify_stats stats;
+    int count = equix_solve(ctx, &nonce, sizeof(nonce), sols);
+    assert(count > 0);
+    assert(equix_verify(auto_ctx, &nonce, sizeof(nonce), &sols[0]) == EQUIX_OK);
+    assert(equix_verify_batch(auto_ctx, &nonce, sizeof(nonce), sols, count, results) == (size_t)count);
+    equix_get_verify_stats(auto_ctx, &stats);
+    assert(stats.interpreted + stats.compiled == (uint64_t)count + 1);
+    assert(stats.compilations <= 1);
+    equix_free(auto_ctx);
+    return true;
+}
+
+static bool test_prefix() {
+    static const char seed[32] = "equix prefix test seed";
+    uint8_t challenge[sizeof(seed) + sizeof(nonce)];
+    equix_solution expected[EQUIX_MAX_SOLS];
+    equix_solution output[EQUIX_MAX_SOLS];
+    equix_prefix prefix;
+    assert(equix_prefix_init(&prefix, seed, sizeof(seed)));
+    memcpy(challenge, seed, sizeof(seed));
+    memcpy(challenge + sizeof(seed), &nonce, sizeof(nonce));
+    int expected_count = equix_solve(ctx, challenge, sizeof(challenge), expected);
+    int count = equix_solve_suffix(ctx, &prefix, &nonce, sizeof(nonce), output);
+    assert(count == expected_count);
+    assert(memcmp(output, expected, count * sizeof(equix_solution)) == 0);
+    for (int i = 0; i < count; ++i) {
+        assert(equix_verify_suffix(ctx, &prefix, &nonce, sizeof(nonce), &output[i]) == EQUIX_OK);
+    }
+    return true;
+}
+
+static bool test_profile() {
+    const char* path = "equix-tests.profile";
+    equix_profile saved = { EQUIX_CTX_HUGEPAGES, 4, 1234.5 };
+    equix_profile loaded;
+    if (!equix_profile_save(&saved, path)) {
+        return false;
+    }
+    assert(equix_profile_load(&loaded, path));
+    remove(path);
+    assert(loaded.flags == saved.flags);
+    assert(loaded.threads == saved.threads);
+    assert(loaded.solutions_per_sec == saved.solutions_per_sec);
+    FILE* f = fopen(path, "w");
+    assert(f != NULL);
+    fprintf(f, "threads=4\n");
+    fclose(f);
+    assert(!equix_profile_load(&loaded, path));
+    remove(path);
+    return true;
+}
+
+static bool test_race() {
+    static const char seed[] = "equix race test";
+    equix_prefix prefix;
+    equix_solution solution, expected[EQUIX_MAX_SOLS];
+    uint8_t challenge[EQUIX_MAX_PREFIXED_CHALLENGE];
+    uint8_t suffix[8];
+    uint64_t found_nonce;
+    assert(equix_prefix_init(&prefix, seed, sizeof(seed)));
+    equix_race* race = equix_race_alloc(&prefix, 0, 1, NULL, NULL);
+    assert(race != NULL);
+    assert(equix_race_run(race, ctx, 0) == 1);
+    assert(equix_race_result(race, &found_nonce, &solution) == 1);
+    equix_race_free(race);
+    for (int i = 0; i < 8; ++i) {
+        suffix[i] = (uint8_t)(found_nonce >> (8 * i));
+    }
+    size_t size = equix_prefix_challenge(&prefix, suffix, sizeof(suffix), challenge);
+    assert(equix_solve(ctx, challenge, size, expected) > 0);
+    assert(memcmp(&solution, &expected[0], sizeof(solution)) == 0);
+    race = equix_race_alloc(&prefix, 0, 1, NULL, NULL);
+    equix_race_cancel(race);
+    assert(equix_race_run(race, ctx, 0) == 0);
+    assert(equix_race_result(race, &found_nonce, &solution) == 0);
+    equix_race_free(race);
+    return true;
+}
+
+static bool test_cache() {
+    equix_solution expected[EQUIX_MAX_SOLS];
+    equix_solution output[EQUIX_MAX_SOLS];
+    equix_cache_stats stats;
+    int expected_count = equix_solve(ctx, &nonce, sizeof(nonce), expected);
+    equix_cache* cache = equix_cache_alloc(16, 3600);
+    assert(cache != NULL);
+    for (int i = 0; i < 2; ++i) {
+        int count = equix_cache_solve(cache, ctx, &nonce, sizeof(nonce), output);
+        assert(count == expected_count);
+        assert(memcmp(output, expected, count * sizeof(equix_solution)) == 0);
+    }
+    equix_cache_get_stats(cache, &stats);
+    assert(stats.hits == 1 && stats.misses == 1);
+    equix_cache_free(cache);
+    /* a verifier context finds no solutions, which must not be cached */
+    equix_ctx* verifier = equix_alloc(EQUIX_CTX_VERIFY);
+    assert(verifier != NULL && verifier != EQUIX_NOTSUPP);
+    cache = equix_cache_alloc(16, 3600);
+    assert(cache != NULL);
+    assert(equix_cache_solve(cache, verifier, &nonce, sizeof(nonce), output) == 0);
+    assert(equix_cache_solve(cache, ctx, &nonce, sizeof(nonce), output) == expected_count);
+    equix_cache_free(cache);
+    equix_free(verifier);
+    cache = equix_cache_alloc(16, -1); /* every entry is expired */
+    assert(cache != NULL);
+    equix_cache_solve(cache, ctx, &nonce, sizeof(nonce), output);
+    equix_cache_solve(cache, ctx, &nonce, sizeof(nonce), output);
+    equix_cache_get_stats(cache, &stats);
+    assert(stats.hits == 0 && stats.misses == 2 && stats.expired == 1);
+    equix_cache_free(cache);
+    return true;
+}
+
 #define RUN_TEST(x) run_test(#x, &x)
 
 static void run_test(const char* name, test_func* func) {
@@ -116,7 +330,18 @@ int main() {
     RUN_TEST(test_verify2);
     RUN_TEST(test_verify3);
     RUN_TEST(test_verify4);
+    RUN_TEST(test_verify_repeat);
     RUN_TEST(test_permutations);
+    RUN_TEST(test_solve_prepared);
+    RUN_TEST(test_solve_split);
+    RUN_TEST(test_lowmem);
+    RUN_TEST(test_queue);
+    RUN_TEST(test_try_compile);
+    RUN_TEST(test_auto_compile);
+    RUN_TEST(test_prefix);
+    RUN_TEST(test_profile);
+    RUN_TEST(test_race);
+    RUN_TEST(test_cache);
     RUN_TEST(test_free);
 
     printf("\nAll tests were successful\n");
@@ -0,0 +1,15 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include "trace.h"
+
+#ifdef EQUIX_TRACE
+
+/* set by the kernel while a tracer is attached to the probe */
+#define EQUIX_PROBE_SEMAPHORE(name) \
+    EQUIX_PRIVATE volatile unsigned short equix_##name##_semaphore \
+    __attribute__((unused, section(".probes")));
+EQUIX_PROBE_LIST(EQUIX_PROBE_SEMAPHORE)
+#undef EQUIX_PROBE_SEMAPHORE
+
+#endif
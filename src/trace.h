@@ -0,0 +1,80 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Static tracepoints (USDT) for bpftrace, perf and SystemTap. They compile
+ * to a single nop when no tracer is attached. Arguments that are expensive
+ * to compute, such as the challenge digest, are only computed while a
+ * tracer is attached to the probe (EQUIX_PROBE_ENABLED).
+ *
+ * Build with -DEQUIX_TRACE=OFF to remove them completely.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <equix.h>
+#include <hashx.h>
+
+#ifdef EQUIX_TRACE
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define EQUIX_PROBE_LIST(X) \
+    X(make_start)           \
+    X(make_done)            \
+    X(solve_start)          \
+    X(solve_done)           \
+    X(stage_start)          \
+    X(stage_done)           \
+    X(build_start)          \
+    X(build_done)           \
+    X(verify_start)         \
+    X(verify_exit)          \
+    X(verify_done)
+
+#define EQUIX_PROBE_SEMAPHORE(name) \
+    EQUIX_PRIVATE extern volatile unsigned short equix_##name##_semaphore;
+EQUIX_PROBE_LIST(EQUIX_PROBE_SEMAPHORE)
+#undef EQUIX_PROBE_SEMAPHORE
+
+#define EQUIX_PROBE_ENABLED(name) __builtin_expect(equix_##name##_semaphore != 0, 0)
+#define EQUIX_PROBE1(name, a) DTRACE_PROBE1(equix, name, a)
+#define EQUIX_PROBE2(name, a, b) DTRACE_PROBE2(equix, name, a, b)
+#define EQUIX_PROBE3(name, a, b, c) DTRACE_PROBE3(equix, name, a, b, c)
+
+#else
+
+/* the arguments are still evaluated to avoid unused variable warnings */
+#define EQUIX_PROBE_ENABLED(name) 0
+#define EQUIX_PROBE1(name, a) do { (void)(a); } while (0)
+#define EQUIX_PROBE2(name, a, b) do { (void)(a); (void)(b); } while (0)
+#define EQUIX_PROBE3(name, a, b, c) do { (void)(a); (void)(b); (void)(c); } while (0)
+
+#endif
+
+/* FNV-1a digest of a challenge for the probe arguments */
+static inline uint64_t trace_digest(const void* challenge, size_t size) {
+    const uint8_t* data = (const uint8_t*)challenge;
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+#define EQUIX_TRACE_DIGEST(name, challenge, size) \
+    (EQUIX_PROBE_ENABLED(name) ? trace_digest(challenge, size) : 0)
+
+/* hashx_make with the make_start and make_done probes */
+static inline int traced_make(const void* ctx, hashx_ctx* hash_func, const void* challenge, size_t size) {
+    EQUIX_PROBE3(make_start, ctx, EQUIX_TRACE_DIGEST(make_start, challenge, size), size);
+    int valid = hashx_make(hash_func, challenge, size);
+    EQUIX_PROBE2(make_done, ctx, valid);
+    return valid;
+}
+
+#endif
@@ -0,0 +1,149 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <equix.h>
+#include <test_utils.h>
+#include <hashx_thread.h>
+#include <hashx_time.h>
+
+#ifdef EQUIX_WIN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+typedef struct tune_job {
+    hashx_thread thread;
+    equix_ctx* ctx;
+    int seed;
+    int step;
+    double deadline;
+    int64_t total_sols;
+} tune_job;
+
+static hashx_thread_retval worker(void* args) {
+    tune_job* job = (tune_job*)args;
+    equix_solution sols[EQUIX_MAX_SOLS];
+    job->total_sols = 0;
+    do {
+        job->total_sols += equix_solve(job->ctx, &job->seed, sizeof(job->seed), sols);
+        job->seed += job->step;
+    } while (hashx_time() < job->deadline);
+    return HASHX_THREAD_SUCCESS;
+}
+
+static int online_cpus(void) {
+#ifdef EQUIX_WIN
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
+
+/* solutions per second with the given number of threads */
+static double measure_threads(equix_ctx_flags flags, int threads, double seconds) {
+    tune_job* jobs = malloc(sizeof(tune_job) * threads);
+    if (jobs == NULL) {
+        return 0;
+    }
+    int allocated = 0;
+    for (; allocated < threads; ++allocated) {
+        jobs[allocated].ctx = equix_alloc(flags);
+        if (jobs[allocated].ctx == NULL || jobs[allocated].ctx == EQUIX_NOTSUPP) {
+            break;
+        }
+    }
+    double rate = 0;
+    if (allocated == threads) {
+        double start = hashx_time();
+        for (int thd = 0; thd < threads; ++thd) {
+            jobs[thd].seed = thd;
+            jobs[thd].step = threads;
+            jobs[thd].deadline = start + seconds;
+        }
+        for (int thd = 1; thd < threads; ++thd) {
+            jobs[thd].thread = hashx_thread_create(&worker, &jobs[thd]);
+        }
+        worker(&jobs[0]);
+        int64_t total_sols = jobs[0].total_sols;
+        for (int thd = 1; thd < threads; ++thd) {
+            hashx_thread_join(jobs[thd].thread);
+            total_sols += jobs[thd].total_sols;
+        }
+        rate = total_sols / (hashx_time() - start);
+    }
+    for (int thd = 0; thd < allocated; ++thd) {
+        equix_free(jobs[thd].ctx);
+    }
+    free(jobs);
+    return rate;
+}
+
+static void print_help(char* executable) {
+    printf("Usage: %s [OPTIONS]\n", executable);
+    printf("Supported options:\n");
+    printf("  --help          show this message\n");
+    printf("  --seconds S     measure each configuration for about S seconds (default: S=2)\n");
+    printf("  --max-threads T try up to T threads (default: number of CPUs)\n");
+    printf("  --out PATH      write the profile to PATH (default: equix.profile)\n");
+}
+
+static const char* read_string_option(const char* option, int argc, char** argv, const char* default_val) {
+    for (int i = 0; i < argc - 1; ++i) {
+        if (strcmp(argv[i], option) == 0) {
+            return argv[i + 1];
+        }
+    }
+    return default_val;
+}
+
+int main(int argc, char** argv) {
+    int seconds, max_threads;
+    bool help;
+    read_option("--help", argc, argv, &help);
+    if (help) {
+        print_help(argv[0]);
+        return 0;
+    }
+    read_int_option("--seconds", argc, argv, &seconds, 2);
+    read_int_option("--max-threads", argc, argv, &max_threads, online_cpus());
+    const char* path = read_string_option("--out", argc, argv, "equix.profile");
+    if (seconds < 1) {
+        seconds = 1;
+    }
+    equix_profile profile;
+    printf("Measuring solver configurations ...\n");
+    if (!equix_tune(&profile, seconds)) {
+        printf("Error: cannot create a solver context\n");
+        return 1;
+    }
+    equix_ctx_flags flags = EQUIX_CTX_SOLVE | profile.flags;
+    printf("compile: %i, hugepages: %i, %f solutions/sec.\n",
+        (profile.flags & EQUIX_CTX_COMPILE) != 0,
+        (profile.flags & EQUIX_CTX_HUGEPAGES) != 0,
+        profile.solutions_per_sec);
+    profile.threads = 1;
+    for (int threads = 2; threads <= max_threads; threads *= 2) {
+        double rate = measure_threads(flags, threads, seconds);
+        printf("threads: %i, %f solutions/sec.\n", threads, rate);
+        /* stop when another doubling gains less than 10% */
+        if (rate < profile.solutions_per_sec * 1.1) {
+            break;
+        }
+        profile.threads = threads;
+        profile.solutions_per_sec = rate;
+    }
+    if (!equix_profile_save(&profile, path)) {
+        printf("Error: cannot write %s\n", path);
+        return 1;
+    }
+    printf("Profile written to %s (threads: %i)\n", path, profile.threads);
+    return 0;
+}
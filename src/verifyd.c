@@ -0,0 +1,122 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <equix.h>
+#include <equix_ring.h>
+#include <test_utils.h>
+#include <hashx_thread.h>
+
+typedef struct verifier_job {
+    hashx_thread thread;
+    equix_ring* ring;
+    equix_ctx* ctx;
+    int batch;
+    uint64_t total;
+} verifier_job;
+
+static hashx_thread_retval verifier(void* args) {
+    verifier_job* job = (verifier_job*)args;
+    unsigned count;
+    while ((count = equix_ring_serve(job->ring, job->ctx, job->batch)) != 0) {
+        job->total += count;
+    }
+    return HASHX_THREAD_SUCCESS;
+}
+
+static void print_help(char* executable) {
+    printf("Usage: %s [OPTIONS]\n", executable);
+    printf("Supported options:\n");
+    printf("  --help        show this message\n");
+    printf("  --name NAME   ring name under /dev/shm (default: equix)\n");
+    printf("  --slots L     use 2^L ring slots, 3-16 (default: L=10)\n");
+    printf("  --threads T   use T verifier threads (default: T=1)\n");
+    printf("  --batch B     verify at most B records per batch (default: B=32)\n");
+    printf("  --interpret   use HashX interpreter\n");
+}
+
+static const char* read_string_option(const char* option, int argc, char** argv, const char* default_val) {
+    for (int i = 0; i < argc - 1; ++i) {
+        if (strcmp(argv[i], option) == 0) {
+            return argv[i + 1];
+        }
+    }
+    return default_val;
+}
+
+int main(int argc, char** argv) {
+    int slots_log2, threads, batch;
+    bool interpret, help;
+    read_option("--help", argc, argv, &help);
+    if (help) {
+        print_help(argv[0]);
+        return 0;
+    }
+    const char* name = read_string_option("--name", argc, argv, "equix");
+    read_int_option("--slots", argc, argv, &slots_log2, 10);
+    read_int_option("--threads", argc, argv, &threads, 1);
+    read_int_option("--batch", argc, argv, &batch, 32);
+    read_option("--interpret", argc, argv, &interpret);
+    equix_ctx_flags flags = EQUIX_CTX_VERIFY;
+    if (!interpret) {
+        flags |= EQUIX_CTX_COMPILE;
+    }
+    /* handle termination signals in the main thread only */
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGINT);
+    sigaddset(&sigset, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+    equix_ring* ring = equix_ring_create(name, slots_log2);
+    if (ring == NULL) {
+        printf("Error: cannot create ring /dev/shm/%s\n", name);
+        return 1;
+    }
+    verifier_job* jobs = malloc(sizeof(verifier_job) * threads);
+    if (jobs == NULL) {
+        printf("Error: memory allocation failure\n");
+        return 1;
+    }
+    for (int thd = 0; thd < threads; ++thd) {
+        jobs[thd].ctx = equix_alloc(flags);
+        if (jobs[thd].ctx == NULL) {
+            printf("Error: memory allocation failure\n");
+            return 1;
+        }
+        if (jobs[thd].ctx == EQUIX_NOTSUPP) {
+            printf("Error: not supported. Try with --interpret\n");
+            return 1;
+        }
+        jobs[thd].ring = ring;
+        jobs[thd].batch = batch;
+        jobs[thd].total = 0;
+    }
+    for (int thd = 0; thd < threads; ++thd) {
+        jobs[thd].thread = hashx_thread_create(&verifier, &jobs[thd]);
+    }
+    printf("Serving /dev/shm/%s (slots: %i, interpret: %i, threads: %i, batch: %i) ...\n",
+        name, 1 << slots_log2, interpret, threads, batch);
+    fflush(stdout);
+    int sig;
+    sigwait(&sigset, &sig);
+    equix_ring_shutdown(ring);
+    uint64_t total = 0;
+    for (int thd = 0; thd < threads; ++thd) {
+        hashx_thread_join(jobs[thd].thread);
+        total += jobs[thd].total;
+        equix_free(jobs[thd].ctx);
+    }
+    printf("%llu records verified\n", (unsigned long long)total);
+    equix_ring_close(ring);
+    char path[256];
+    snprintf(path, sizeof(path), "/dev/shm/%s", name);
+    unlink(path);
+    free(jobs);
+    return 0;
+}
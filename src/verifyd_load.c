@@ -0,0 +1,174 @@
+/* Copyright (c) 2020 tevador <tevador@gmail.com> */
+/* See LICENSE for licensing information */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <equix.h>
+#include <equix_ring.h>
+#include <test_utils.h>
+#include <hashx_thread.h>
+#include <hashx_time.h>
+
+#define MAX_DEPTH 64
+
+typedef struct record {
+    int nonce;
+    equix_solution sol;
+} record;
+
+typedef struct client_job {
+    hashx_thread thread;
+    equix_ring* ring;
+    const record* records;
+    int num_records;
+    int requests;
+    int depth;
+    int offset;
+    int failures;
+    double* latencies;
+} client_job;
+
+static hashx_thread_retval client(void* args) {
+    client_job* job = (client_job*)args;
+    equix_ring_ticket tickets[MAX_DEPTH];
+    double start[MAX_DEPTH];
+    job->failures = 0;
+    for (int req = 0; req < job->requests; req += job->depth) {
+        int batch = job->requests - req < job->depth ? job->requests - req : job->depth;
+        for (int i = 0; i < batch; ++i) {
+            const record* rec = &job->records[(job->offset + req + i) % job->num_records];
+            start[i] = hashx_time();
+            if (!equix_ring_submit(job->ring, &rec->nonce, sizeof(rec->nonce), &rec->sol, &tickets[i])) {
+                job->failures += batch - i;
+                return HASHX_THREAD_SUCCESS;
+            }
+        }
+        for (int i = 0; i < batch; ++i) {
+            equix_result result = equix_ring_wait(job->ring, tickets[i]);
+            job->latencies[req + i] = hashx_time() - start[i];
+            job->failures += result != EQUIX_OK;
+        }
+    }
+    return HASHX_THREAD_SUCCESS;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_help(char* executable) {
+    printf("Usage: %s [OPTIONS]\n", executable);
+    printf("Supported options:\n");
+    printf("  --help        show this message\n");
+    printf("  --name NAME   ring name under /dev/shm (default: equix)\n");
+    printf("  --nonces N    solve N nonces to generate records (default: N=20)\n");
+    printf("  --clients C   use C client threads (default: C=1)\n");
+    printf("  --requests R  submit R requests per client (default: R=10000)\n");
+    printf("  --depth D     keep D requests in flight per client (default: D=1, max. 64)\n");
+}
+
+static const char* read_string_option(const char* option, int argc, char** argv, const char* default_val) {
+    for (int i = 0; i < argc - 1; ++i) {
+        if (strcmp(argv[i], option) == 0) {
+            return argv[i + 1];
+        }
+    }
+    return default_val;
+}
+
+int main(int argc, char** argv) {
+    int nonces, clients, requests, depth;
+    bool help;
+    read_option("--help", argc, argv, &help);
+    if (help) {
+        print_help(argv[0]);
+        return 0;
+    }
+    const char* name = read_string_option("--name", argc, argv, "equix");
+    read_int_option("--nonces", argc, argv, &nonces, 20);
+    read_int_option("--clients", argc, argv, &clients, 1);
+    read_int_option("--requests", argc, argv, &requests, 10000);
+    read_int_option("--depth", argc, argv, &depth, 1);
+    if (depth > MAX_DEPTH) {
+        depth = MAX_DEPTH;
+    }
+    equix_ring* ring = equix_ring_open(name);
+    if (ring == NULL) {
+        printf("Error: cannot open ring /dev/shm/%s (is equix-verifyd running?)\n", name);
+        return 1;
+    }
+    equix_ctx* ctx = equix_alloc(EQUIX_CTX_SOLVE);
+    record* records = malloc(sizeof(record) * nonces * EQUIX_MAX_SOLS);
+    client_job* jobs = malloc(sizeof(client_job) * clients);
+    if (ctx == NULL || ctx == EQUIX_NOTSUPP || records == NULL || jobs == NULL) {
+        printf("Error: memory allocation failure\n");
+        return 1;
+    }
+    int num_records = 0;
+    for (int nonce = 0; nonce < nonces; ++nonce) {
+        equix_solution sols[EQUIX_MAX_SOLS];
+        int count = equix_solve(ctx, &nonce, sizeof(nonce), sols);
+        for (int sol = 0; sol < count; ++sol) {
+            records[num_records].nonce = nonce;
+            records[num_records].sol = sols[sol];
+            num_records++;
+        }
+    }
+    equix_free(ctx);
+    if (num_records == 0) {
+        printf("Error: no solutions found\n");
+        return 1;
+    }
+    for (int thd = 0; thd < clients; ++thd) {
+        jobs[thd].ring = ring;
+        jobs[thd].records = records;
+        jobs[thd].num_records = num_records;
+        jobs[thd].requests = requests;
+        jobs[thd].depth = depth;
+        jobs[thd].offset = thd * 7;
+        jobs[thd].latencies = calloc(requests, sizeof(double));
+        if (jobs[thd].latencies == NULL) {
+            printf("Error: memory allocation failure\n");
+            return 1;
+        }
+    }
+    printf("Submitting %i requests (records: %i, clients: %i, depth: %i) ...\n",
+        requests * clients, num_records, clients, depth);
+    double time_start = hashx_time();
+    for (int thd = 0; thd < clients; ++thd) {
+        jobs[thd].thread = hashx_thread_create(&client, &jobs[thd]);
+    }
+    for (int thd = 0; thd < clients; ++thd) {
+        hashx_thread_join(jobs[thd].thread);
+    }
+    double elapsed = hashx_time() - time_start;
+    double* latencies = malloc(sizeof(double) * requests * clients);
+    if (latencies == NULL) {
+        printf("Error: memory allocation failure\n");
+        return 1;
+    }
+    int failures = 0;
+    for (int thd = 0; thd < clients; ++thd) {
+        memcpy(&latencies[thd * requests], jobs[thd].latencies, sizeof(double) * requests);
+        failures += jobs[thd].failures;
+        free(jobs[thd].latencies);
+    }
+    int total = requests * clients;
+    qsort(latencies, total, sizeof(double), &compare_double);
+    printf("%f verifications/sec.\n", total / elapsed);
+    printf("latency: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+        latencies[total / 2] * 1e6, latencies[total * 99 / 100] * 1e6,
+        latencies[total - 1] * 1e6);
+    if (failures != 0) {
+        printf("Error: %i verifications failed\n", failures);
+    }
+    free(latencies);
+    free(jobs);
+    free(records);
+    equix_ring_close(ring);
+    return failures != 0;
+}